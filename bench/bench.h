@@ -0,0 +1,13 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <time.h>
+
+/* seconds on the monotonic clock */
+static double
+now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
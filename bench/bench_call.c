@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "list.h"
+#include "functional.h"
+#include "closure.h"
+#include "tagged.h"
+#include "gc.h"
+#include "bench.h"
+
+/* per-call cost of lmap (env copied for every element) against
+lmap_fast (env set up once), for a few env sizes */
+
+static void *
+addall(list *env) {
+  int sum = 0;
+  for (list *curr = env; curr != NULL; curr = curr->next) {
+    sum += intval(((envobj *)curr->val)->val);
+  }
+  return (void *)TAGINT(sum);
+}
+
+int
+main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+  int sizes[] = { 1, 2, 8, 32 };
+
+  gc_init();
+  list *in = liftlist(trange(1, n), 0);
+  for (int k = 0; k < 4; ++k) {
+    closure *cl = bind(NULL, addall, tliftint(1));
+    for (int i = 1; i < sizes[k]; ++i) {
+      bind(cl, addall, tliftint(1));
+    }
+    double t = now();
+    lmap(in, cl);
+    double slow = (now() - t) / n * 1e9;
+    t = now();
+    lmap_fast(in, cl);
+    double fast = (now() - t) / n * 1e9;
+    printf("env %2d: lmap %7.1f ns/call, lmap_fast %7.1f ns/call\n",
+           sizes[k], slow, fast);
+  }
+  return 0;
+}
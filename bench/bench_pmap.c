@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "list.h"
+#include "functional.h"
+#include "wsched.h"
+#include "gc.h"
+#include "bench.h"
+
+/* pmap scaling: the same expensive pure callback over the same list,
+on 1, 2, 4 and one-per-cpu threads */
+
+static void *
+churn(void *v, void *args) {
+  unsigned x = *(int *)v;
+  int rounds = *(int *)args;
+  for (int i = 0; i < rounds; ++i) {
+    x = x * 1103515245u + 12345u;
+  }
+  return boxint((int)(x >> 1));
+}
+
+int
+main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+  int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int threads[] = { 1, 2, 4, cpus };
+  double base = 0;
+
+  gc_init();
+  list *in = range(1, n);
+  for (int k = 0; k < 4; ++k) {
+    if (k == 3 && (cpus == 1 || cpus == 2 || cpus == 4)) {
+      break;
+    }
+    sched_init(threads[k]);
+    double t = now();
+    pmap(in, churn, &rounds);
+    t = now() - t;
+    if (k == 0) {
+      base = t;
+    }
+    schedstats st;
+    sched_stats(-1, &st);
+    printf("pmap %3d threads: %8.3f s  speedup %5.2fx  (%lu steals, %lu idle)\n",
+      threads[k], t, base / t, st.steals, st.idle);
+  }
+  sched_shutdown();
+  gc_collect();
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "list.h"
+#include "functional.h"
+#include "typed.h"
+#include "gc.h"
+#include "bench.h"
+
+/* generic map/filter (boxed ints, callbacks through void *) vs the
+macro generated map_int/filter_int with inlinable callbacks.  both
+sides triple, keep the odd ones (half of them) and count what's kept */
+
+static void *
+triple(void *v, void *args) {
+  return boxint(*(int *)v * 3);
+}
+
+static bool
+odd(void *v, void *args) {
+  return *(int *)v % 2;
+}
+
+static void
+count(void *v, void *args) {
+  ++*(long *)args;
+}
+
+static inline int
+triple_int(int v) {
+  return v * 3;
+}
+
+static inline bool
+odd_int(int v) {
+  return v % 2;
+}
+
+static inline int
+count_int(int acc, int v) {
+  return acc + 1;
+}
+
+int
+main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 10;
+  double t;
+  long kept = 0;
+
+  gc_init();
+  list *l = range(0, n - 1);
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    iter(filter(map(l, triple, NULL), odd, NULL), count, &kept);
+  }
+  t = now() - t;
+  printf("map/filter        : %8.2f Melem/s (%ld kept)\n", (double)n * reps / t / 1e6, kept);
+  gc_collect();
+
+  intvec v = range_int(0, n - 1);
+  kept = 0;
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    intvec m = map_int(&v, triple_int);
+    intvec f = filter_int(&m, odd_int);
+    kept += fold_int(&f, count_int, 0);
+    intvec_free(&m);
+    intvec_free(&f);
+  }
+  t = now() - t;
+  printf("map_int/filter_int: %8.2f Melem/s (%ld kept)\n", (double)n * reps / t / 1e6, kept);
+  intvec_free(&v);
+  return 0;
+}
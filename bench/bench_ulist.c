@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "list.h"
+#include "ulist.h"
+#include "functional.h"
+#include "gc.h"
+#include "bench.h"
+
+/* traversal throughput: list (one node per element) vs ulist (chunked).
+first with one list built on its own, where consecutive nodes happen to
+sit next to each other anyway, then with BUCKETS lists built at once
+round robin (grouping by key, say), where they don't */
+#define BUCKETS 64
+
+static void
+sum(void *v, void *args) {
+  *(long *)args += *(int *)v;
+}
+
+int
+main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 20;
+  int *vals = malloc(n * sizeof(int));
+  listbuilder b;
+  ulist u;
+  long total;
+  double t;
+
+  gc_init();
+  builder_init(&b);
+  u = newulist();
+  for (int i = 0; i < n; ++i) {
+    vals[i] = i;
+    builder_append(&b, &vals[i]);
+    u = uappend(u, &vals[i]);
+  }
+
+  total = 0;
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    iter(builder_list(&b), sum, &total);
+  }
+  t = now() - t;
+  printf("list  iter: %8.2f Melem/s (sum %ld)\n", (double)n * reps / t / 1e6, total);
+
+  total = 0;
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    uiter(u, sum, &total);
+  }
+  t = now() - t;
+  printf("ulist iter: %8.2f Melem/s (sum %ld)\n", (double)n * reps / t / 1e6, total);
+
+  listbuilder *bb = malloc(BUCKETS * sizeof(listbuilder));
+  ulist *ub = malloc(BUCKETS * sizeof(ulist));
+  for (int k = 0; k < BUCKETS; ++k) {
+    builder_init(&bb[k]);
+    ub[k] = newulist();
+  }
+  for (int i = 0; i < n; ++i) {
+    builder_append(&bb[i % BUCKETS], &vals[i]);
+    ub[i % BUCKETS] = uappend(ub[i % BUCKETS], &vals[i]);
+  }
+
+  total = 0;
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    for (int k = 0; k < BUCKETS; ++k) {
+      iter(builder_list(&bb[k]), sum, &total);
+    }
+  }
+  t = now() - t;
+  printf("list  iter, %d buckets: %8.2f Melem/s (sum %ld)\n", BUCKETS, (double)n * reps / t / 1e6, total);
+
+  total = 0;
+  t = now();
+  for (int r = 0; r < reps; ++r) {
+    for (int k = 0; k < BUCKETS; ++k) {
+      uiter(ub[k], sum, &total);
+    }
+  }
+  t = now() - t;
+  printf("ulist iter, %d buckets: %8.2f Melem/s (sum %ld)\n", BUCKETS, (double)n * reps / t / 1e6, total);
+
+  gc_collect();
+  free(bb);
+  free(ub);
+  free(vals);
+  return 0;
+}
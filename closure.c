@@ -1,15 +1,42 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "list.h"
 #include "closure.h"
 #include "gc.h"
+#include "slab.h"
+#include "tagged.h"
+
+static slabpool closurepool = SLABPOOL_INIT(sizeof(closure));
+static slabpool boxpool = SLABPOOL_INIT(sizeof(int));
+
+/* the small int cache and the intern table.  nothing in either is
+registered with the gc, so they live for the whole program; don't
+write through their vals */
+#define SMALLINTS (LIFTINT_MAX - LIFTINT_MIN + 1)
+static int smallvals[SMALLINTS];
+static envobj smallints[SMALLINTS];
+static pthread_once_t smallonce = PTHREAD_ONCE_INIT;
+
+typedef struct internslot {
+  uint64_t hash;
+  envobj *env;
+} internslot;
+
+static struct {
+  internslot *slots;
+  size_t capacity;
+  size_t count;
+  pthread_mutex_t lock;
+} interned = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
 
 envobj *
 envitem(void *var, ssize_t size) {
-  envobj *env = malloc(sizeof(envobj));
+  envobj *env = gc_alloc_cell(ENVOBJ);
   env->val = var;
   env->size = size;
-  gc_register((void *)env, ENVOBJ);
   return env;
 }
 
@@ -23,59 +50,364 @@ closure *
 bind(closure *c, void *(*fn)(list *), envobj *env) {
   closure *cl;
   if (c == NULL) {
-    cl = malloc(sizeof(closure)); 
-    if (cl == NULL) {
-      exit(1);
-    }
+    cl = slab_alloc(&closurepool); 
     cl->env = NULL;
     cl->fn = fn;
+    cl->into = NULL;
+    cl->outsize = 0;
     gc_register((void *)cl, CLOSURE);
   }
   else {
     cl = c;
   }
   cl->env = append(cl->env, (void *)env); 
+  gc_barrier(cl);
   return cl;
 }
 
+/* bind for bodies that write their result into storage the caller
+hands them, into(env, out, out_size), instead of returning a pointer
+to something they allocated.  a closure can have both kinds of body.
+out_size is the size of the result, for when a closure with only an
+into body is called the ordinary way (see apply) */
+closure *
+bind_into(closure *c, void (*into)(list *, void *, size_t), size_t out_size, envobj *env) {
+  closure *cl = bind(c, NULL, env);
+  if (c == NULL) {
+    cl->fn = NULL;
+  }
+  cl->into = into;
+  cl->outsize = out_size;
+  return cl;
+}
+
+/* runs c's body on a whole argument list (env ++ args).  a closure
+with only an into body gets a fresh gc'd slot of outsize bytes to
+write into, and that's what comes back, so everything that takes a
+closure works with either kind */
+void *
+apply(closure *c, list *args) {
+  if (c->fn != NULL) {
+    return c->fn(args);
+  }
+  void *out = gc_malloc(c->outsize > 0 ? c->outsize : 1, STANDARD);
+  c->into(args, out, c->outsize);
+  return out;
+}
+
 void *
 call(closure *c, envobj *env) {
-  list *copylist = copy(c->env);
-  copylist = append(copylist, (void *)env);
-  return c->fn(copylist);
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  for (curr = c->env; curr != NULL; curr = curr->next) {
+    builder_append(&b, curr->val);
+  }
+  builder_append(&b, (void *)env);
+  return apply(c, builder_list(&b));
+}
+
+/* the result goes into out, which has room for out_size bytes.  a
+closure without an into body gets its fn called and out_size bytes
+copied out of whatever it returns */
+void
+call_into(closure *c, envobj *env, void *out, size_t out_size) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  for (curr = c->env; curr != NULL; curr = curr->next) {
+    builder_append(&b, curr->val);
+  }
+  builder_append(&b, (void *)env);
+  if (c->into != NULL) {
+    c->into(builder_list(&b), out, out_size);
+  }
+  else {
+    memcpy(out, apply(c, builder_list(&b)), out_size);
+  }
+}
+
+/* call with two arguments; the body sees env ++ [a, b] */
+void *
+call2(closure *c, envobj *a, envobj *b) {
+  listbuilder lb;
+  list *curr;
+  builder_init(&lb);
+  for (curr = c->env; curr != NULL; curr = curr->next) {
+    builder_append(&lb, curr->val);
+  }
+  builder_append(&lb, (void *)a);
+  builder_append(&lb, (void *)b);
+  return apply(c, builder_list(&lb));
+}
+
+/* flat closures.  bind and call above still work the old way; these
+are separate so existing list-walking bodies don't have to change */
+fclosure *
+newfclosure(void *(*fn)(fclosure *, envobj *), int capacity) {
+  fclosure *c = malloc(sizeof(fclosure) + capacity * sizeof(envobj *));
+  if (c == NULL) {
+    exit(1);
+  }
+  c->fn = fn;
+  c->arity = 0;
+  c->capacity = capacity;
+  gc_register((void *)c, FCLOSURE);
+  return c;
+}
+
+/* binds the next captured value; it's an error to bind more than the
+capacity */
+fclosure *
+fbind(fclosure *c, envobj *env) {
+  if (c->arity == c->capacity) {
+    exit(1);
+  }
+  c->env[c->arity++] = env;
+  gc_barrier(c);
+  return c;
+}
+
+void *
+fcall(fclosure *c, envobj *env) {
+  return c->fn(c, env);
+}
+
+/* a frame is the env list call would build, made once: the closure's
+env followed by one node for the argument, all in a single malloc'd
+block that the gc doesn't know about.  each frame_call just swaps the
+argument in, so the body must not hang on to (or change) the list it
+gets. */
+void
+frame_init(callframe *f, closure *c) {
+  size_t n = 1;
+  list *curr;
+  for (curr = c->env; curr != NULL; curr = curr->next) {
+    ++n;
+  }
+  f->cl = c;
+  f->nodes = malloc(n * sizeof(list));
+  if (f->nodes == NULL) {
+    exit(1);
+  }
+  size_t i = 0;
+  for (curr = c->env; curr != NULL; curr = curr->next, ++i) {
+    f->nodes[i].val = curr->val;
+    f->nodes[i].next = &f->nodes[i + 1];
+  }
+  f->arg = &f->nodes[n - 1];
+  f->arg->val = NULL;
+  f->arg->next = NULL;
+}
+
+void *
+frame_call(callframe *f, envobj *env) {
+  f->arg->val = (void *)env;
+  return apply(f->cl, f->nodes);
+}
+
+void
+frame_call_into(callframe *f, envobj *env, void *out, size_t out_size) {
+  f->arg->val = (void *)env;
+  if (f->cl->into != NULL) {
+    f->cl->into(f->nodes, out, out_size);
+  }
+  else {
+    memcpy(out, apply(f->cl, f->nodes), out_size);
+  }
+}
+
+void
+frame_free(callframe *f) {
+  free(f->nodes);
+  f->nodes = f->arg = NULL;
+}
+
+/* out[i] = call(c, args[i]) for n arguments, with one env setup */
+void
+call_batch(closure *c, envobj **args, size_t n, void **out) {
+  callframe f;
+  frame_init(&f, c);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = frame_call(&f, args[i]);
+  }
+  frame_free(&f);
 }
 
 //helper functions (syntactic sugar...erm...i guess...)
 //these make using closures easier
+int *
+boxint(int a) {
+  int *v = slab_alloc(&boxpool);
+  *v = a;
+  gc_register((void *)v, BOXED);
+  return v;
+}
+
+static void
+smallints_init(void) {
+  for (int i = 0; i < SMALLINTS; ++i) {
+    smallvals[i] = LIFTINT_MIN + i;
+    smallints[i].val = &smallvals[i];
+    smallints[i].size = sizeof(int);
+  }
+}
+
+/* ints in [LIFTINT_MIN, LIFTINT_MAX] come from the cache, so lifting
+them allocates nothing */
 envobj *
 liftint(int a) {
-  int *v = malloc(sizeof(int));
-  *v = a;
-  gc_register((void *)v, STANDARD);
+  if (a >= LIFTINT_MIN && a <= LIFTINT_MAX) {
+    pthread_once(&smallonce, smallints_init);
+    return &smallints[a - LIFTINT_MIN];
+  }
+  int *v = boxint(a);
   envobj *o = envitem((void *)v, sizeof(int)); 
   return o;
 }
 
+/* fnv-1a over the bytes; a size of 0 or less means val isn't a pointer
+to anything (a tagged int, say), so the pointer itself is the key */
+static uint64_t
+internhash(const void *val, ssize_t size) {
+  const unsigned char *p = size > 0 ? val : (const void *)&val;
+  size_t n = size > 0 ? (size_t)size : sizeof(val);
+  uint64_t h = 14695981039346656037ull ^ (uint64_t)size;
+  for (size_t i = 0; i < n; ++i) {
+    h = (h ^ p[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+static bool
+internsame(envobj *e, const void *val, ssize_t size) {
+  if (e->size != size) {
+    return false;
+  }
+  return size > 0 ? memcmp(e->val, val, size) == 0 : e->val == val;
+}
+
+static void
+interngrow(void) {
+  size_t capacity = interned.capacity ? interned.capacity * 2 : 64;
+  internslot *slots = calloc(capacity, sizeof(internslot));
+  if (slots == NULL) {
+    exit(1);
+  }
+  for (size_t i = 0; i < interned.capacity; ++i) {
+    internslot *old = &interned.slots[i];
+    if (old->env != NULL) {
+      size_t j = old->hash & (capacity - 1);
+      while (slots[j].env != NULL) {
+        j = (j + 1) & (capacity - 1);
+      }
+      slots[j] = *old;
+    }
+  }
+  free(interned.slots);
+  interned.slots = slots;
+  interned.capacity = capacity;
+}
+
+/* the one permanent envobj for these size bytes at val (the bytes are
+copied).  the same bytes always give back the same envobj, so lifting a
+constant you use a lot costs a lookup, not an allocation */
+envobj *
+intern(const void *val, ssize_t size) {
+  uint64_t h = internhash(val, size);
+  pthread_mutex_lock(&interned.lock);
+  if (2 * (interned.count + 1) > interned.capacity) {
+    interngrow();
+  }
+  size_t i = h & (interned.capacity - 1);
+  for (; interned.slots[i].env != NULL; i = (i + 1) & (interned.capacity - 1)) {
+    internslot *slot = &interned.slots[i];
+    if (slot->hash == h && internsame(slot->env, val, size)) {
+      pthread_mutex_unlock(&interned.lock);
+      return slot->env;
+    }
+  }
+  envobj *e = malloc(sizeof(envobj) + (size > 0 ? size : 0));
+  if (e == NULL) {
+    exit(1);
+  }
+  if (size > 0) {
+    e->val = e + 1;
+    memcpy(e->val, val, size);
+  }
+  else {
+    e->val = (void *)val;
+  }
+  e->size = size;
+  interned.slots[i].hash = h;
+  interned.slots[i].env = e;
+  ++interned.count;
+  pthread_mutex_unlock(&interned.lock);
+  return e;
+}
+
+/* a lifted tagged int: the value lives in val itself, so size is 0
+and there's nothing behind it to allocate */
+envobj *
+tliftint(int a) {
+  return envitem(TAGINT(a), 0);
+}
+
+/* unbox for ints, tagged or not */
+int
+unboxint(list *l) {
+  envobj *env = (envobj *)l->val;
+  return intval(env->val);
+}
+
 void
 envobj_free(void *_obj) {
-  envobj *obj = _obj;
-  free(obj);
+  gc_free_cell(_obj);
 }
 
 list *
 liftlist(list *l, ssize_t s) {
-  list *o = NULL;
+  listbuilder b;
   list *curr;
 
+  builder_init(&b);
   for (curr = l; curr != NULL; curr = curr->next) {
      envobj *lifted = envitem(curr->val, s); 
-     o = append(o, (void *)lifted);
+     builder_append(&b, (void *)lifted);
   }
-  return o;
+  return builder_list(&b);
 }
 
 void
 closure_free(void *_c) {
-  closure *c = _c;
-  free(c);
+  slab_free(_c);
+}
+
+void
+fclosure_free(void *_c) {
+  free(_c);
+}
+
+void
+box_free(void *_b) {
+  slab_free(_b);
+}
+
+/* tracers for the gc: what each kind of object keeps alive */
+void
+envobj_trace(void *_obj, void (*visit)(void *)) {
+  visit(((envobj *)_obj)->val);
+}
+
+void
+closure_trace(void *_c, void (*visit)(void *)) {
+  visit(((closure *)_c)->env);
+}
+
+void
+fclosure_trace(void *_c, void (*visit)(void *)) {
+  fclosure *c = _c;
+  for (int i = 0; i < c->arity; ++i) {
+    visit(c->env[i]);
+  }
 }
@@ -3,8 +3,19 @@
 #include <unistd.h>
 #include "list.h"
 
+/* liftint hands out preallocated envobjs for ints in this range instead
+of making new ones; override with -D to change it */
+#ifndef LIFTINT_MIN
+#define LIFTINT_MIN -128
+#endif
+#ifndef LIFTINT_MAX
+#define LIFTINT_MAX 1023
+#endif
+
 typedef struct closure {
   void *(*fn)(list *);
+  void (*into)(list *, void *, size_t); /* see bind_into; NULL if not set */
+  size_t outsize; /* how much room call makes for into's result */
   list *env;
 } closure;
 
@@ -13,13 +24,54 @@ typedef struct envobj {
   ssize_t size;
 } envobj;
 
+/* a flat closure: the captured values are an array inside the closure
+itself, so the whole thing is one allocation and env_get(c, i) is an
+index.  capacity is fixed when it's made; arity is how many have been
+bound so far.  the body gets the closure and the argument. */
+typedef struct fclosure {
+  void *(*fn)(struct fclosure *, envobj *);
+  int arity;
+  int capacity;
+  envobj *env[];
+} fclosure;
+
+#define env_get(c, i) ((c)->env[(i)])
+
+/* a reusable env for calling one closure many times (see frame_init) */
+typedef struct callframe {
+  closure *cl;
+  list *nodes;
+  list *arg;
+} callframe;
+
 envobj *envitem(void *var, ssize_t s);
 void *unbox(list *l); 
 closure *bind(closure *c, void *(*fn)(list *), envobj *env);
 void *call(closure *c, envobj *env);
+void *call2(closure *c, envobj *a, envobj *b);
+closure *bind_into(closure *c, void (*into)(list *, void *, size_t), size_t out_size, envobj *env);
+void *apply(closure *c, list *args);
+void call_into(closure *c, envobj *env, void *out, size_t out_size);
+void call_batch(closure *c, envobj **args, size_t n, void **out);
+void frame_init(callframe *f, closure *c);
+void *frame_call(callframe *f, envobj *env);
+void frame_call_into(callframe *f, envobj *env, void *out, size_t out_size);
+void frame_free(callframe *f);
+fclosure *newfclosure(void *(*fn)(fclosure *, envobj *), int capacity);
+fclosure *fbind(fclosure *c, envobj *env);
+void *fcall(fclosure *c, envobj *env);
+int *boxint(int a);
 envobj *liftint(int a); 
+envobj *tliftint(int a);
+envobj *intern(const void *val, ssize_t size);
+int unboxint(list *l);
 list *liftlist(list *l, ssize_t s); 
 void envobj_free(void *);
 void closure_free(void *);
+void fclosure_free(void *);
+void box_free(void *);
+void envobj_trace(void *, void (*)(void *));
+void closure_trace(void *, void (*)(void *));
+void fclosure_trace(void *, void (*)(void *));
 
 #endif 
@@ -3,6 +3,9 @@
 #include "list.h"
 #include "functional.h"
 #include "closure.h"
+#include "gc.h"
+#include "tagged.h"
+#include "wsched.h"
 
 /* some standard functional programming functions */
 void
@@ -15,44 +18,499 @@ iter(list *l, void (*fn)(void *, void *), void *args) {
 
 list *
 map(list *l, void *(*fn)(void *, void *), void *args) {
-  list *o = NULL;
+  listbuilder b;
   list *curr;
+  builder_init(&b);
   for (curr = l; curr != NULL; curr = curr->next) {
-    o = append(o, (*fn)(curr->val, args));
+    builder_append(&b, (*fn)(curr->val, args));
   }
-  return o;
+  return builder_list(&b);
 }
 
 list *
 lmap(list *l, closure *cl) {
-  list *o = NULL;
+  listbuilder b;
   list *curr;
+  builder_init(&b);
   for (curr = l; curr != NULL; curr = curr->next) {
-    o = append(o, call(cl, (envobj *)curr->val)); 
+    builder_append(&b, call(cl, (envobj *)curr->val)); 
   }
-  return o;
+  return builder_list(&b);
+}
+
+/* map and lmap into a buffer the caller provides: element i of the
+result goes at out + i * elsize, and the number written is returned.
+out needs room for one elsize result per element of l */
+size_t
+map_into(list *l, void (*fn)(void *, void *, void *), void *out, size_t elsize, void *args) {
+  char *o = out;
+  size_t n = 0;
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next, ++n) {
+    (*fn)(o + n * elsize, curr->val, args);
+  }
+  return n;
+}
+
+size_t
+lmap_into(list *l, closure *cl, void *out, size_t elsize) {
+  char *o = out;
+  size_t n = 0;
+  list *curr;
+  callframe f;
+  frame_init(&f, cl);
+  for (curr = l; curr != NULL; curr = curr->next, ++n) {
+    frame_call_into(&f, (envobj *)curr->val, o + n * elsize, elsize);
+  }
+  frame_free(&f);
+  return n;
+}
+
+/* lmap for flat closures */
+list *
+flmap(list *l, fclosure *cl) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    builder_append(&b, fcall(cl, (envobj *)curr->val));
+  }
+  return builder_list(&b);
+}
+
+/* lmap without the env copy per element (see frame_init); the closure
+body mustn't keep the list it's passed */
+list *
+lmap_fast(list *l, closure *cl) {
+  listbuilder b;
+  list *curr;
+  callframe f;
+  builder_init(&b);
+  frame_init(&f, cl);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    builder_append(&b, frame_call(&f, (envobj *)curr->val));
+  }
+  frame_free(&f);
+  return builder_list(&b);
 }
 
 list *
 filter(list *l, bool (*fn)(void *, void *), void *args) {
-  list *o = NULL;
+  listbuilder b;
   list *curr;
+  builder_init(&b);
   for (curr = l; curr != NULL; curr = curr->next) {
     if ((*fn)(curr->val, args)) {
-      o = append(o, copyitem(curr->val));
+      builder_append(&b, curr->val);
     }
   }
-  return o;
+  return builder_list(&b);
+}
+
+/* the destructive versions: l is used up and the result is built out
+of its nodes.  map_inplace overwrites each val; filter_inplace unlinks
+the rejected nodes and gives them straight back to the allocator, so
+nothing is left for the gc.  only use these when nothing else points
+into l. */
+list *
+map_inplace(list *l, void *(*fn)(void *, void *), void *args) {
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    curr->val = (*fn)(curr->val, args);
+    gc_barrier(curr);
+  }
+  return l;
+}
+
+list *
+filter_inplace(list *l, bool (*fn)(void *, void *), void *args) {
+  list *head = l, **link = &head, *curr, *prev = NULL;
+  while ((curr = *link) != NULL) {
+    if ((*fn)(curr->val, args)) {
+      link = &curr->next;
+      prev = curr;
+    }
+    else {
+      *link = curr->next;
+      if (prev != NULL) {
+        gc_barrier(prev);
+      }
+      gc_remove(curr);
+      list_free(curr);
+    }
+  }
+  return head;
 }
 
 /* not lazy */
 list *
 range(int start, int end) {
-  list *o = NULL;
+  listbuilder b;
+  builder_init(&b);
   for (int i = start; i <= end; ++i) {
-    int *aloc = malloc(sizeof(int));
-    *aloc = i;  
-    o = append(o, (void *)aloc);
+    builder_append(&b, (void *)boxint(i));
+  }
+  return builder_list(&b);
+}
+
+/* parallel map: the list is flattened so the workers can index into it,
+the results are written into a matching array, and the output list
+is built from that on the calling thread */
+typedef struct pmapjob {
+  void **in;
+  void **out;
+  void *(*fn)(void *, void *);
+  void *args;
+  closure *cl;
+} pmapjob;
+
+/* the vals of l in an array; NULL for an empty list */
+static void **
+flatten(list *l, size_t *n) {
+  size_t len = 0;
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    len++;
   }
+  *n = len;
+  if (len == 0) {
+    return NULL;
+  }
+  void **a = malloc(len * sizeof(void *));
+  if (a == NULL) {
+    exit(1);
+  }
+  len = 0;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    a[len++] = curr->val;
+  }
+  return a;
+}
+
+static list *
+unflatten(void **a, size_t n) {
+  listbuilder b;
+  builder_init(&b);
+  for (size_t i = 0; i < n; ++i) {
+    builder_append(&b, a[i]);
+  }
+  return builder_list(&b);
+}
+
+static void
+pmaptask(void *ctx, size_t lo, size_t hi) {
+  pmapjob *j = ctx;
+  for (size_t i = lo; i < hi; ++i) {
+    j->out[i] = (*j->fn)(j->in[i], j->args);
+  }
+}
+
+static void
+plmaptask(void *ctx, size_t lo, size_t hi) {
+  pmapjob *j = ctx;
+  for (size_t i = lo; i < hi; ++i) {
+    j->out[i] = call(j->cl, (envobj *)j->in[i]);
+  }
+}
+
+list *
+pmap(list *l, void *(*fn)(void *, void *), void *args) {
+  pmapjob j;
+  size_t n;
+  if (l == NULL) {
+    return NULL;
+  }
+  j.in = flatten(l, &n);
+  j.out = malloc(n * sizeof(void *));
+  if (j.out == NULL) {
+    exit(1);
+  }
+  j.fn = fn;
+  j.args = args;
+  sched_for(n, pmaptask, &j);
+  list *o = unflatten(j.out, n);
+  free(j.in);
+  free(j.out);
   return o;
 }
+
+list *
+plmap(list *l, closure *cl) {
+  pmapjob j;
+  size_t n;
+  if (l == NULL) {
+    return NULL;
+  }
+  j.in = flatten(l, &n);
+  j.out = malloc(n * sizeof(void *));
+  if (j.out == NULL) {
+    exit(1);
+  }
+  j.cl = cl;
+  sched_for(n, plmaptask, &j);
+  list *o = unflatten(j.out, n);
+  free(j.in);
+  free(j.out);
+  return o;
+}
+
+/* folds */
+void *
+foldl(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args) {
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    acc = (*fn)(acc, curr->val, args);
+  }
+  return acc;
+}
+
+/* walks the flattened list backwards instead of recursing */
+void *
+foldr(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args) {
+  size_t n;
+  void **a = flatten(l, &n);
+  while (n > 0) {
+    n--;
+    acc = (*fn)(a[n], acc, args);
+  }
+  free(a);
+  return acc;
+}
+
+/* acc, fn(acc, x1), fn(fn(acc, x1), x2), ... */
+list *
+scanl(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  builder_append(&b, acc);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    acc = (*fn)(acc, curr->val, args);
+    builder_append(&b, acc);
+  }
+  return builder_list(&b);
+}
+
+void *
+reduce(list *l, void *(*fn)(void *, void *, void *), void *args) {
+  if (l == NULL) {
+    return NULL;
+  }
+  return foldl(l->next, fn, l->val, args);
+}
+
+/* parallel reduce: each block of the array is reduced on its own,
+then neighbouring partials are combined pairwise, level by level */
+typedef struct preducejob {
+  void **a;
+  size_t n;
+  size_t block;
+  size_t stride;
+  void *(*fn)(void *, void *, void *);
+  void *args;
+} preducejob;
+
+static void
+blocktask(void *ctx, size_t lo, size_t hi) {
+  preducejob *j = ctx;
+  for (size_t b = lo; b < hi; ++b) {
+    size_t start = b * j->block;
+    size_t end = start + j->block < j->n ? start + j->block : j->n;
+    void *acc = j->a[start];
+    for (size_t i = start + 1; i < end; ++i) {
+      acc = (*j->fn)(acc, j->a[i], j->args);
+    }
+    j->a[start] = acc;
+  }
+}
+
+static void
+pairtask(void *ctx, size_t lo, size_t hi) {
+  preducejob *j = ctx;
+  for (size_t p = lo; p < hi; ++p) {
+    size_t left = 2 * p * j->stride;
+    size_t right = left + j->stride;
+    j->a[left] = (*j->fn)(j->a[left], j->a[right], j->args);
+  }
+}
+
+void *
+preduce(list *l, void *(*fn)(void *, void *, void *), void *args) {
+  preducejob j;
+  size_t nblocks;
+  if (l == NULL) {
+    return NULL;
+  }
+  j.a = flatten(l, &j.n);
+  j.fn = fn;
+  j.args = args;
+  nblocks = (size_t)(sched_size() > 0 ? sched_size() : 1) * 8;
+  j.block = (j.n + nblocks - 1) / nblocks;
+  nblocks = (j.n + j.block - 1) / j.block;
+  sched_for(nblocks, blocktask, &j);
+  /* partials sit at multiples of block; combine them as a tree */
+  for (j.stride = j.block; j.stride < j.n; j.stride *= 2) {
+    size_t pairs = (j.n - 1) / (2 * j.stride);
+    if ((j.n - 1) % (2 * j.stride) >= j.stride) {
+      pairs++;
+    }
+    sched_for(pairs, pairtask, &j);
+  }
+  void *o = j.a[0];
+  free(j.a);
+  return o;
+}
+
+/* folds for closures */
+envobj *
+lfoldl(list *l, closure *cl, envobj *acc) {
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    acc = envitem(call2(cl, acc, (envobj *)curr->val), acc->size);
+  }
+  return acc;
+}
+
+envobj *
+lfoldr(list *l, closure *cl, envobj *acc) {
+  size_t n;
+  void **a = flatten(l, &n);
+  while (n > 0) {
+    n--;
+    acc = envitem(call2(cl, (envobj *)a[n], acc), acc->size);
+  }
+  free(a);
+  return acc;
+}
+
+list *
+lscanl(list *l, closure *cl, envobj *acc) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  builder_append(&b, acc);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    acc = envitem(call2(cl, acc, (envobj *)curr->val), acc->size);
+    builder_append(&b, acc);
+  }
+  return builder_list(&b);
+}
+
+envobj *
+lreduce(list *l, closure *cl) {
+  if (l == NULL) {
+    return NULL;
+  }
+  return lfoldl(l->next, cl, (envobj *)l->val);
+}
+
+/* tagged ints */
+list *
+trange(int start, int end) {
+  listbuilder b;
+  builder_init(&b);
+  for (int i = start; i <= end; ++i) {
+    builder_append(&b, TAGINT(i));
+  }
+  return builder_list(&b);
+}
+
+list *
+tmap(list *l, int (*fn)(int, void *), void *args) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    builder_append(&b, TAGINT((*fn)(intval(curr->val), args)));
+  }
+  return builder_list(&b);
+}
+
+list *
+tfilter(list *l, bool (*fn)(int, void *), void *args) {
+  listbuilder b;
+  list *curr;
+  builder_init(&b);
+  for (curr = l; curr != NULL; curr = curr->next) {
+    if ((*fn)(intval(curr->val), args)) {
+      builder_append(&b, curr->val);
+    }
+  }
+  return builder_list(&b);
+}
+
+void
+titer(list *l, void (*fn)(int, void *), void *args) {
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    (*fn)(intval(curr->val), args);
+  }
+}
+
+/* numeric vectors */
+static void
+checknum(vector *v, NUMTYPE t) {
+  if (v->elsize != num_size(t)) {
+    exit(1);
+  }
+}
+
+vector *
+vaddk(vector *v, NUMTYPE t, const void *k) {
+  checknum(v, t);
+  vector *o = newvector(v->elsize, v->length);
+  num_addk(t, o->data, v->data, v->length, k);
+  o->length = v->length;
+  return o;
+}
+
+vector *
+vmulk(vector *v, NUMTYPE t, const void *k) {
+  checknum(v, t);
+  vector *o = newvector(v->elsize, v->length);
+  num_mulk(t, o->data, v->data, v->length, k);
+  o->length = v->length;
+  return o;
+}
+
+vector *
+vselect(vector *v, NUMTYPE t, CMP op, const void *k) {
+  checknum(v, t);
+  vector *o = newvector(v->elsize, v->length);
+  o->length = num_select(t, o->data, v->data, v->length, op, k);
+  return o;
+}
+
+vector *
+vparity(vector *v, NUMTYPE t, bool odd) {
+  checknum(v, t);
+  vector *o = newvector(v->elsize, v->length);
+  o->length = num_parity(t, o->data, v->data, v->length, odd);
+  return o;
+}
+
+vector *
+vbetween(vector *v, NUMTYPE t, const void *lo, const void *hi) {
+  checknum(v, t);
+  vector *o = newvector(v->elsize, v->length);
+  o->length = num_between(t, o->data, v->data, v->length, lo, hi);
+  return o;
+}
+
+void
+vsum(vector *v, NUMTYPE t, void *out) {
+  checknum(v, t);
+  num_sum(t, v->data, v->length, out);
+}
+
+void
+vmin(vector *v, NUMTYPE t, void *out) {
+  checknum(v, t);
+  num_min(t, v->data, v->length, out);
+}
+
+void
+vmax(vector *v, NUMTYPE t, void *out) {
+  checknum(v, t);
+  num_max(t, v->data, v->length, out);
+}
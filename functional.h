@@ -2,16 +2,82 @@
 #define FUNCTIONAL_H
 #include "list.h"
 #include "closure.h"
+#include "vector.h"
+#include "simd.h"
 
 void iter(list *l, void (*fn)(void *, void *), void *args); 
 
 list *map(list *l, void *(*fn)(void *, void *), void *args); 
 /* map for lifted types */
 list *lmap(list *l, closure *cl); 
+/* same, but the env is set up once for the whole list */
+list *lmap_fast(list *l, closure *cl);
+/* and for flat closures */
+list *flmap(list *l, fclosure *cl);
+
+/* map and lmap writing straight into out, one elsize slot per element,
+instead of allocating each result; they return the count.  fn is
+fn(out, x, args), and lmap_into uses the closure's into body
+(see bind_into), setting its env up once like lmap_fast */
+size_t map_into(list *l, void (*fn)(void *, void *, void *), void *out, size_t elsize, void *args);
+size_t lmap_into(list *l, closure *cl, void *out, size_t elsize);
 
 list *filter(list *l, bool (*fn)(void *, void *), void *args); 
 
+/* same as map and filter, but they reuse l's nodes instead of making a
+new list, and l can't be used afterwards.  filter_inplace frees the
+nodes it drops, so nothing else may point at them. */
+list *map_inplace(list *l, void *(*fn)(void *, void *), void *args);
+list *filter_inplace(list *l, bool (*fn)(void *, void *), void *args);
+
 list *range(int start, int end); 
 
+/* parallel map on the work-stealing scheduler (wsched.h); results come
+back in input order.  fn and the closure body run concurrently, so they
+shouldn't touch shared state (allocating through the gc is fine), but
+they may use the parallel functions themselves. */
+list *pmap(list *l, void *(*fn)(void *, void *), void *args);
+list *plmap(list *l, closure *cl);
+
+/* folds.  fn(acc, x, args) for the left ones, fn(x, acc, args) for
+foldr; they return the new acc.  reduce uses the first element as acc
+and returns NULL for an empty list.  preduce is reduce on the
+scheduler: fn must be associative, and partial results are combined in a
+balanced tree, left to right. */
+void *foldl(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args);
+void *foldr(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args);
+list *scanl(list *l, void *(*fn)(void *, void *, void *), void *acc, void *args);
+void *reduce(list *l, void *(*fn)(void *, void *, void *), void *args);
+void *preduce(list *l, void *(*fn)(void *, void *, void *), void *args);
+
+/* folds for lifted types: the closure body sees its env followed by
+acc and x (x then acc for lfoldr), and each result is lifted again
+with acc's size */
+envobj *lfoldl(list *l, closure *cl, envobj *acc);
+envobj *lfoldr(list *l, closure *cl, envobj *acc);
+list *lscanl(list *l, closure *cl, envobj *acc);
+envobj *lreduce(list *l, closure *cl);
+
+/* tagged int versions (see tagged.h): elements are ints packed into
+the pointer, so nothing gets allocated per element.  tmap, tfilter
+and titer also accept lists of boxed int *s. */
+list *trange(int start, int end);
+list *tmap(list *l, int (*fn)(int, void *), void *args);
+list *tfilter(list *l, bool (*fn)(int, void *), void *args);
+void titer(list *l, void (*fn)(int, void *), void *args);
+
+/* numeric fast paths for vectors of I32, I64, F32 or F64 (simd.h);
+v's elsize has to match t.  these run vectorised kernels instead of
+calling a function per element.  the map and filter ones return a new
+vector; vsum writes an int64_t or a double, vmin and vmax a t. */
+vector *vaddk(vector *v, NUMTYPE t, const void *k);
+vector *vmulk(vector *v, NUMTYPE t, const void *k);
+vector *vselect(vector *v, NUMTYPE t, CMP op, const void *k);
+vector *vparity(vector *v, NUMTYPE t, bool odd);
+vector *vbetween(vector *v, NUMTYPE t, const void *lo, const void *hi);
+void vsum(vector *v, NUMTYPE t, void *out);
+void vmin(vector *v, NUMTYPE t, void *out);
+void vmax(vector *v, NUMTYPE t, void *out);
+
 #endif
 
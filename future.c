@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "list.h"
+#include "closure.h"
+#include "future.h"
+#include "wsched.h"
+#include "gc.h"
+
+/* something to do when a future finishes: fire(src, w) */
+struct waiter {
+  void (*fire)(future *, waiter *);
+  future *target;
+  size_t index;
+  waiter *next;
+};
+
+/* every future that isn't done yet, newest first */
+static future *inflight = NULL;
+static pthread_mutex_t inflight_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* bodies run holding the read side; a collect takes the write side,
+so it only traces when none are halfway through */
+static pthread_rwlock_t running = PTHREAD_RWLOCK_INITIALIZER;
+static _Thread_local int inbody = 0;
+
+static future *
+newfuture(void) {
+  future *f = malloc(sizeof(future));
+  if (f == NULL) {
+    exit(1);
+  }
+  atomic_init(&f->done, 0);
+  f->result = NULL;
+  f->cl = NULL;
+  f->arg = NULL;
+  pthread_mutex_init(&f->lock, NULL);
+  f->waiters = NULL;
+  f->results = NULL;
+  f->nresults = 0;
+  atomic_init(&f->pending, 0);
+  atomic_init(&f->claimed, 0);
+  gc_register((void *)f, FUTURE);
+  pthread_mutex_lock(&inflight_lock);
+  f->prev = NULL;
+  f->next = inflight;
+  if (inflight != NULL) {
+    inflight->prev = f;
+  }
+  inflight = f;
+  pthread_mutex_unlock(&inflight_lock);
+  return f;
+}
+
+/* sets the result and runs whatever was waiting on it, in the order
+it was added */
+static void
+complete(future *f, void *result) {
+  pthread_mutex_lock(&f->lock);
+  f->result = result;
+  atomic_store(&f->done, 1);
+  waiter *w = f->waiters, *rev = NULL;
+  f->waiters = NULL;
+  pthread_mutex_unlock(&f->lock);
+  gc_barrier(f); /* not under f->lock: the trace takes that inside the gc's */
+  /* whoever's waiting is still a root through rev until it fires */
+  pthread_mutex_lock(&inflight_lock);
+  if (f->prev != NULL) {
+    f->prev->next = f->next;
+  }
+  else {
+    inflight = f->next;
+  }
+  if (f->next != NULL) {
+    f->next->prev = f->prev;
+  }
+  pthread_mutex_unlock(&inflight_lock);
+  while (w != NULL) {
+    waiter *next = w->next;
+    w->next = rev;
+    rev = w;
+    w = next;
+  }
+  while (rev != NULL) {
+    waiter *next = rev->next;
+    rev->fire(f, rev);
+    free(rev);
+    rev = next;
+  }
+}
+
+static void
+addwaiter(future *f, void (*fire)(future *, waiter *), future *target, size_t index) {
+  waiter *w = malloc(sizeof(waiter));
+  if (w == NULL) {
+    exit(1);
+  }
+  w->fire = fire;
+  w->target = target;
+  w->index = index;
+  pthread_mutex_lock(&f->lock);
+  if (!atomic_load(&f->done)) {
+    w->next = f->waiters;
+    f->waiters = w;
+    pthread_mutex_unlock(&f->lock);
+    return;
+  }
+  pthread_mutex_unlock(&f->lock);
+  fire(f, w);
+  free(w);
+}
+
+static void
+runfuture(void *ctx) {
+  future *f = ctx;
+  pthread_rwlock_rdlock(&running);
+  ++inbody;
+  complete(f, call(f->cl, f->arg));
+  --inbody;
+  pthread_rwlock_unlock(&running);
+}
+
+static void
+thenfire(future *src, waiter *w) {
+  envobj *arg = envitem(src->result, 0);
+  pthread_mutex_lock(&w->target->lock);
+  w->target->arg = arg;
+  pthread_mutex_unlock(&w->target->lock);
+  gc_barrier(w->target);
+  sched_post(runfuture, w->target);
+}
+
+static void
+allfire(future *src, waiter *w) {
+  future *g = w->target;
+  pthread_mutex_lock(&g->lock);
+  g->results[w->index] = src->result;
+  pthread_mutex_unlock(&g->lock);
+  gc_barrier(g);
+  if (atomic_fetch_sub(&g->pending, 1) == 1) {
+    listbuilder b;
+    builder_init(&b);
+    for (size_t i = 0; i < g->nresults; ++i) {
+      builder_append(&b, g->results[i]);
+    }
+    pthread_mutex_lock(&g->lock);
+    free(g->results);
+    g->results = NULL;
+    pthread_mutex_unlock(&g->lock);
+    complete(g, builder_list(&b));
+  }
+}
+
+static void
+anyfire(future *src, waiter *w) {
+  int expected = 0;
+  if (atomic_compare_exchange_strong(&w->target->claimed, &expected, 1)) {
+    complete(w->target, src->result);
+  }
+}
+
+/* public functions */
+future *
+spawn(closure *cl, envobj *arg) {
+  future *f = newfuture();
+  f->cl = cl;
+  f->arg = arg;
+  sched_post(runfuture, f);
+  return f;
+}
+
+void *
+future_get(future *f) {
+  while (!atomic_load(&f->done)) {
+    if (!sched_help()) {
+      sched_yield();
+    }
+  }
+  return f->result;
+}
+
+future *
+future_then(future *f, closure *cl) {
+  future *g = newfuture();
+  g->cl = cl;
+  addwaiter(f, thenfire, g, 0);
+  return g;
+}
+
+future *
+future_all(future **fs, size_t n) {
+  future *g = newfuture();
+  if (n == 0) {
+    complete(g, NULL);
+    return g;
+  }
+  g->results = calloc(n, sizeof(void *));
+  if (g->results == NULL) {
+    exit(1);
+  }
+  g->nresults = n;
+  atomic_store(&g->pending, n);
+  for (size_t i = 0; i < n; ++i) {
+    addwaiter(fs[i], allfire, g, i);
+  }
+  return g;
+}
+
+future *
+future_any(future **fs, size_t n) {
+  future *g = newfuture();
+  if (n == 0) {
+    complete(g, NULL);
+    return g;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    addwaiter(fs[i], anyfire, g, i);
+  }
+  return g;
+}
+
+void
+future_free(void *_f) {
+  future *f = _f;
+  pthread_mutex_destroy(&f->lock);
+  free(f->results);
+  free(f);
+}
+
+/* for the gc: the closure, argument and result, future_all's results
+so far, and the futures waiting on this one */
+void
+future_trace(void *_f, void (*visit)(void *)) {
+  future *f = _f;
+  pthread_mutex_lock(&f->lock);
+  visit(f->cl);
+  visit(f->arg);
+  if (atomic_load(&f->done)) {
+    visit(f->result);
+  }
+  for (size_t i = 0; f->results != NULL && i < f->nresults; ++i) {
+    visit(f->results[i]);
+  }
+  for (waiter *w = f->waiters; w != NULL; w = w->next) {
+    visit(w->target);
+  }
+  pthread_mutex_unlock(&f->lock);
+}
+
+/* every future that isn't done is a root */
+void
+future_roots(void (*visit)(void *)) {
+  pthread_mutex_lock(&inflight_lock);
+  for (future *f = inflight; f != NULL; f = f->next) {
+    visit(f);
+  }
+  pthread_mutex_unlock(&inflight_lock);
+}
+
+/* called by the gc around a trace.  from inside a body there's no
+waiting for the others, since they may be waiting on this one */
+void
+futures_pause(void) {
+  if (inbody == 0) {
+    pthread_rwlock_wrlock(&running);
+  }
+}
+
+void
+futures_resume(void) {
+  if (inbody == 0) {
+    pthread_rwlock_unlock(&running);
+  }
+}
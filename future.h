@@ -0,0 +1,55 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "closure.h"
+
+/* futures: spawn(cl, arg) starts call(cl, arg) on the scheduler
+(wsched.h) and hands back a future for its result straight away.
+future_get waits for it, running other tasks in the meantime.
+
+futures are registered with the gc, and a future keeps its result
+(and the closure and argument it was made from) alive for as long as
+the future itself is reachable.  until it finishes, a future is a
+root whether anything points at it or not, and so is whatever is
+waiting on it (future_then, future_all, future_any).  a collect waits
+for bodies that are already running to return before it traces, so
+what they're in the middle of making isn't swept out from under
+them; a collect from inside a body can't wait for itself, and only
+gets the roots. */
+typedef struct waiter waiter;
+
+typedef struct future {
+  atomic_int done;
+  void *result;
+  closure *cl;
+  envobj *arg;
+  pthread_mutex_t lock; /* guards waiters and done's transition */
+  waiter *waiters;
+  void **results;   /* future_all's results so far */
+  size_t nresults;
+  atomic_size_t pending;
+  atomic_int claimed; /* future_any: somebody finished first */
+  struct future *prev; /* on the in-flight list until it's done */
+  struct future *next;
+} future;
+
+future *spawn(closure *cl, envobj *arg);
+void *future_get(future *f);
+/* a future for call(cl, x), where x is f's result lifted with size 0 */
+future *future_then(future *f, closure *cl);
+/* finishes when all of fs have; its result is a list of their results,
+in order */
+future *future_all(future **fs, size_t n);
+/* finishes with the result of whichever of fs finishes first (NULL
+when n is 0) */
+future *future_any(future **fs, size_t n);
+void future_free(void *);
+void future_trace(void *, void (*)(void *));
+/* for the gc */
+void future_roots(void (*visit)(void *));
+void futures_pause(void);
+void futures_resume(void);
+
+#endif
@@ -1,137 +1,378 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 #include "gc.h"
 #include "closure.h"
 #include "list.h"
+#include "slab.h"
+#include "vector.h"
+#include "future.h"
+#include "ulist.h"
+#include "stream.h"
+#include "memo.h"
+#include "nursery.h"
 
+/* every registered obj has a ref in one dense array.  for an obj that
+came out of a slab (boxed ints, closures, copied list nodes) the slab
+keeps the ref's position in its tag (slab_tag), so there's no hashing
+at all; anything else goes in an open addressing table keyed on its
+address.  register, mark, unmark and remove are all O(1) (expected),
+and collect is one pass over the array that drops the dead refs one
+at a time.
+
+collect traces: starting from the roots (the root slots, plus every
+gc_marked obj) it follows each obj's pointers with its type's tracer
+and frees only what it never got to.  pointers that aren't to a
+registered obj (tagged ints, interned envobjs, plain malloc) are
+ignored.
+
+list nodes and envobjs don't go in the table at all: they're cells
+in the nursery (nursery.h), young until they survive a collect.
+gc_collect_minor only traces young cells, from the roots plus the
+remembered set: the table objs registered since the last collect and
+the old objs that gc_barrier was told now point somewhere new.  the
+survivors are promoted where they are. */
 typedef struct ref_ {
   void *ptr; /* pointer to the obj */
   TYPE type; /* obj type */
-  struct ref_ *next; /* refs are stored as a list; */
+  bool marked; /* marked objs are roots: never freed until they're unmarked */
+  bool reached; /* found by the trace in the current collect */
+  bool remembered; /* on the remembered set */
+  bool tagged; /* a slab cell: its slab tag says where this ref is */
 } ref;
 
+/* the pointer is kept in the slot too, so a probe doesn't have to go
+and look in refs */
+typedef struct slot {
+  void *ptr;  /* NULL for an empty slot */
+  size_t pos; /* where its ref is in refs */
+} slot;
+
+typedef struct grey {
+  void *ptr;
+  TYPE type;
+} grey;
+
 typedef struct gc {
-  ref *marked;   /* these will not be freed unless unmarked */
-  ref *last_marked;
-  ref *unmarked; /* these will be freed when gc_collect is called */
-  ref *last_unmarked; /* we want append to be O(1) */
+  ref *refs;
+  size_t count;
+  size_t capacity;
+  slot *index;      /* the refs that aren't tagged */
+  size_t indexsize; /* always a power of two, at least twice nhashed */
+  size_t nhashed;
+  size_t unmarks;   /* bumped by gc_unmark, so collect can tell if a destructor did one */
+  void ***roots;    /* see gc_root */
+  size_t nroots;
+  size_t rootcap;
+  void **remset;    /* objs that may point at young cells */
+  size_t nrem;
+  size_t remcap;
+  grey *stack;      /* the trace's worklist */
+  size_t stacksize;
+  size_t stackcap;
+  ref *dead;        /* detached by the last trace, waiting for their destructors */
+  size_t ndead;
+  size_t deadcap;
+  size_t swept;     /* how many of dead have been destroyed so far */
   void (*destructor_table[TYPE_COUNT])(void *);
+  void (*tracer_table[TYPE_COUNT])(void *, void (*)(void *));
 } gc;
 
 /* this IS the garbage collector */
 static gc _gc;
 
+/* a dead list on its way to the sweeper thread */
+typedef struct sweepbatch sweepbatch;
+struct sweepbatch {
+  ref *dead;
+  size_t ndead;
+  sweepbatch *next;
+};
+
+/* the optional background sweeper: gc_collect hands it whole dead lists
+and carries on, and it runs the destructors */
+static struct {
+  pthread_t thread;
+  bool running;
+  bool quit;
+  bool busy;        /* in the middle of a batch */
+  sweepbatch *head; /* batches waiting, oldest first */
+  sweepbatch *tail;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t idle;
+  atomic_size_t queued;
+  atomic_size_t swept;
+} _sweeper = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .work = PTHREAD_COND_INITIALIZER,
+  .idle = PTHREAD_COND_INITIALIZER
+};
+
+/* only taken while other threads may be registering objects, and
+always on the sweeper thread */
+static pthread_mutex_t gc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int parallel = 0;
+static _Thread_local bool sweeper_thread = false;
+
 /* private functions */
 void gc_register_destructor(TYPE, void (*)(void *));
-ref *refitem(void *, TYPE);
-void append_unmarked(ref *unmarked);
-void append_marked(ref *marked);
-ref *remove_unmarked(void *obj);
-ref *remove_marked(void *obj);
+void gc_register_tracer(TYPE, void (*)(void *, void (*)(void *)));
 void standard_free(void *ptr);
+static bool gc_lock(void);
+static void gc_unlock(bool locked);
+
+static bool
+gc_lock(void) {
+  if (!sweeper_thread && atomic_load(&parallel) == 0) {
+    return false;
+  }
+  pthread_mutex_lock(&gc_mutex);
+  return true;
+}
+
+static void
+gc_unlock(bool locked) {
+  if (locked) {
+    pthread_mutex_unlock(&gc_mutex);
+  }
+}
 
 void
 gc_register_destructor(TYPE type, void (*destructor)(void *)) {
   _gc.destructor_table[type] = destructor;
 }
 
-ref *
-refitem(void *ptr, TYPE type) {
-  ref *o = malloc(sizeof(ref));
-  o->ptr = ptr;
-  o->type = type;
-  o->next = NULL;
-  return o;
+void
+gc_register_tracer(TYPE type, void (*tracer)(void *, void (*)(void *))) {
+  _gc.tracer_table[type] = tracer;
 }
 
-void 
-append_unmarked(ref *unmarked) {
-  if (_gc.unmarked == NULL) {
-    _gc.unmarked = unmarked; 
-    _gc.last_unmarked = _gc.unmarked;
-  }
-  else {
-    _gc.last_unmarked->next = unmarked;
-    _gc.last_unmarked = unmarked; 
+static size_t
+hashptr(void *ptr) {
+  uint64_t h = (uint64_t)(uintptr_t)ptr;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return (size_t)h;
+}
+
+/* the index slot holding ptr, or the empty slot where it would go */
+static size_t
+findslot(void *ptr) {
+  size_t mask = _gc.indexsize - 1;
+  size_t i = hashptr(ptr) & mask;
+  while (_gc.index[i].ptr != NULL && _gc.index[i].ptr != ptr) {
+    i = (i + 1) & mask;
   }
+  return i;
 }
 
-ref *
-remove_unmarked(void *obj) {
-  ref *curr = _gc.unmarked;
-  if (curr == NULL) {
+/* a tag is only believed if the ref it points at is obj's: tags
+aren't cleared when a ref goes, or when the cell is handed out again */
+static ref *
+lookup(void *obj) {
+  uint32_t *tag = slab_tag(obj);
+  if (tag != NULL) {
+    size_t k = *tag;
+    return k != 0 && k <= _gc.count && _gc.refs[k - 1].ptr == obj ? &_gc.refs[k - 1] : NULL;
+  }
+  if (_gc.indexsize == 0) {
     return NULL;
   }
-  if (curr->ptr == obj) {
-    _gc.unmarked = curr->next;
-    curr->next = NULL;
-    return curr;  
+  slot *s = &_gc.index[findslot(obj)];
+  return s->ptr == NULL ? NULL : &_gc.refs[s->pos];
+}
+
+/* empties slot i, shifting later entries of the same probe run back so
+lookups never stop short */
+static void
+unindex(size_t i) {
+  size_t mask = _gc.indexsize - 1;
+  size_t j = i;
+  for (;;) {
+    _gc.index[i].ptr = NULL;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (_gc.index[j].ptr == NULL) {
+        return;
+      }
+      size_t home = hashptr(_gc.index[j].ptr) & mask;
+      if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+        break;
+      }
+    }
+    _gc.index[i] = _gc.index[j];
+    i = j;
   }
-  if (_gc.last_unmarked->ptr == obj) {
-    for (; curr->next->ptr != obj; curr = curr->next)
-      ;
-    ref *o = _gc.last_unmarked;
-    o->next = NULL;
-    _gc.last_unmarked = curr;
-    curr->next = NULL; 
-    return o;     
+}
+
+static void
+reindex(size_t indexsize) {
+  free(_gc.index);
+  _gc.indexsize = indexsize;
+  _gc.index = calloc(indexsize, sizeof(slot));
+  if (_gc.index == NULL) {
+    exit(1);
   }
-  for (; curr->next != NULL; curr = curr->next) {
-    if (curr->next->ptr == obj) {
-      ref *o = curr->next;
-      curr->next = o->next;
-      o->next = NULL;
-      return o;
+  for (size_t k = 0; k < _gc.count; ++k) {
+    if (!_gc.refs[k].tagged) {
+      slot *s = &_gc.index[findslot(_gc.refs[k].ptr)];
+      s->ptr = _gc.refs[k].ptr;
+      s->pos = k;
     }
   }
-  return NULL;
 }
 
-ref *
-remove_marked(void *obj) {
-  ref *curr = _gc.marked;
-  if (curr == NULL) {
-    return NULL;
+/* room for one more ref (and one more index entry: the index only
+grows, by doubling, when something untagged is registered) */
+static void
+grow(bool hashed) {
+  if (_gc.count == _gc.capacity) {
+    size_t capacity = _gc.capacity ? _gc.capacity * 2 : 1024;
+    ref *refs = realloc(_gc.refs, capacity * sizeof(ref));
+    if (refs == NULL) {
+      exit(1);
+    }
+    _gc.refs = refs;
+    _gc.capacity = capacity;
   }
-  if (curr->ptr == obj) {
-    _gc.marked = curr->next;
-    curr->next = NULL;
-    return curr;  
+  if (hashed && 2 * (_gc.nhashed + 1) > _gc.indexsize) {
+    reindex(_gc.indexsize ? _gc.indexsize * 2 : 2048);
   }
-  if (_gc.last_marked->ptr == obj) {
-    for (; curr->next->ptr != obj; curr = curr->next)
-      ;
-    ref *o = _gc.last_marked;
-    o->next = NULL;
-    _gc.last_marked = curr;
-    curr->next = NULL; 
-    return o;     
+}
+
+/* drops refs[k]; the last ref moves into its place, and only its tag
+or its one index slot needs to hear about it */
+static void
+removeref(size_t k) {
+  if (!_gc.refs[k].tagged) {
+    unindex(findslot(_gc.refs[k].ptr));
+    --_gc.nhashed;
   }
-  for (; curr->next != NULL; curr = curr->next) {
-    if (curr->next->ptr == obj) {
-      ref *o = curr->next;
-      curr->next = o->next;
-      o->next = NULL;
-      return o;
+  size_t last = --_gc.count;
+  if (k != last) {
+    _gc.refs[k] = _gc.refs[last];
+    if (_gc.refs[k].tagged) {
+      *slab_tag(_gc.refs[k].ptr) = (uint32_t)(k + 1);
+    }
+    else {
+      _gc.index[findslot(_gc.refs[k].ptr)].pos = k;
     }
   }
-  return NULL;
 }
 
 void
-append_marked(ref *marked) {
-  if (_gc.marked == NULL) {
-    _gc.marked = marked; 
-    _gc.last_marked = _gc.marked;
+standard_free(void *ptr) {
+  free(ptr);
+}
+
+static void
+push(void *ptr, TYPE type) {
+  if (_gc.stacksize == _gc.stackcap) {
+    _gc.stackcap = _gc.stackcap ? _gc.stackcap * 2 : 1024;
+    _gc.stack = realloc(_gc.stack, _gc.stackcap * sizeof(grey));
+    if (_gc.stack == NULL) {
+      exit(1);
+    }
   }
-  else {
-    _gc.last_marked->next = marked;
-    _gc.last_marked = marked; 
+  _gc.stack[_gc.stacksize].ptr = ptr;
+  _gc.stack[_gc.stacksize].type = type;
+  ++_gc.stacksize;
+}
+
+static void
+remember(void *ptr) {
+  if (_gc.nrem == _gc.remcap) {
+    _gc.remcap = _gc.remcap ? _gc.remcap * 2 : 1024;
+    _gc.remset = realloc(_gc.remset, _gc.remcap * sizeof(void *));
+    if (_gc.remset == NULL) {
+      exit(1);
+    }
   }
+  _gc.remset[_gc.nrem++] = ptr;
 }
 
-void
-standard_free(void *ptr) {
-  free(ptr);
+/* what the tracers call for each pointer in an obj */
+static void
+visit(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  if (cell_mark(ptr)) {
+    push(ptr, cell_type(ptr));
+    return;
+  }
+  ref *r = lookup(ptr);
+  if (r != NULL && !r->reached) {
+    r->reached = true;
+    push(r->ptr, r->type);
+  }
+}
+
+/* the same for a minor collect, which stops at anything that isn't a
+young cell */
+static void
+visit_young(void *ptr) {
+  if (ptr != NULL && !cell_old(ptr) && cell_mark(ptr)) {
+    push(ptr, cell_type(ptr));
+  }
+}
+
+static void
+pushcell(void *ptr, TYPE type) {
+  cell_mark(ptr);
+  push(ptr, type);
+}
+
+static void
+drain(void (*v)(void *)) {
+  while (_gc.stacksize > 0) {
+    grey g = _gc.stack[--_gc.stacksize];
+    void (*tracer)(void *, void (*)(void *)) = _gc.tracer_table[g.type];
+    if (tracer != NULL) {
+      (*tracer)(g.ptr, v);
+    }
+  }
+}
+
+/* sets reached on everything the roots lead to; the worklist is
+explicit, so long lists don't use up the C stack */
+static void
+trace(void) {
+  cell_clear_marks(false);
+  for (size_t k = 0; k < _gc.count; ++k) {
+    _gc.refs[k].reached = false;
+  }
+  for (size_t k = 0; k < _gc.count; ++k) {
+    if (_gc.refs[k].marked) {
+      _gc.refs[k].reached = true;
+      push(_gc.refs[k].ptr, _gc.refs[k].type);
+    }
+  }
+  cell_each_pinned(false, pushcell);
+  for (size_t i = 0; i < _gc.nroots; ++i) {
+    visit(*_gc.roots[i]);
+  }
+  future_roots(visit);
+  drain(visit);
+}
+
+/* everything's old after a collect, so nothing needs remembering */
+static void
+forget_all(void) {
+  for (size_t i = 0; i < _gc.nrem; ++i) {
+    ref *r = lookup(_gc.remset[i]);
+    if (r != NULL) {
+      r->remembered = false;
+    }
+  }
+  _gc.nrem = 0;
 }
 
 /* public functions */
@@ -142,44 +383,238 @@ gc_init(void) {
   /* just showing that one could register other destructors */
   gc_register_destructor(ENVOBJ, envobj_free);
   gc_register_destructor(CLOSURE, closure_free);
+  gc_register_destructor(FCLOSURE, fclosure_free);
+  gc_register_destructor(FUTURE, future_free);
   gc_register_destructor(LIST, list_free);
-  gc_register_destructor(STANDARD, standard_free); 
+  gc_register_destructor(STANDARD, standard_free);
+  gc_register_destructor(BOXED, box_free);
+  gc_register_destructor(VECTOR, vector_free);
+  gc_register_destructor(PVECTOR, vector_free);
+  gc_register_destructor(UCHUNK, standard_free);
+  gc_register_destructor(STREAM, standard_free);
+  gc_register_destructor(MEMO, memo_destroy);
+  /* and what each type points at; types without one are leaves */
+  gc_register_tracer(LIST, list_trace);
+  gc_register_tracer(ENVOBJ, envobj_trace);
+  gc_register_tracer(CLOSURE, closure_trace);
+  gc_register_tracer(FCLOSURE, fclosure_trace);
+  gc_register_tracer(FUTURE, future_trace);
+  gc_register_tracer(UCHUNK, uchunk_trace);
+  gc_register_tracer(STREAM, stream_trace);
+  gc_register_tracer(PVECTOR, pvector_trace);
+  gc_register_tracer(MEMO, memo_trace);
   /* don't change these */
-  _gc.marked = NULL;
-  _gc.unmarked = NULL;
-  _gc.last_unmarked = NULL;
-  _gc.last_marked = NULL;
+  gc_stop_sweeper();
+  cell_reset();
+  free(_gc.remset);
+  _gc.remset = NULL;
+  _gc.nrem = _gc.remcap = 0;
+  free(_gc.refs);
+  free(_gc.index);
+  _gc.refs = NULL;
+  _gc.index = NULL;
+  _gc.count = _gc.capacity = _gc.indexsize = _gc.nhashed = 0;
+  _gc.ndead = _gc.swept = 0;
+  _gc.unmarks = 0;
+  _gc.nroots = 0;
+}
+
+/* slot is the address of a variable holding a gc'd pointer (or NULL);
+whatever it holds when gc_collect runs is kept, along with everything
+that can be reached from it */
+void
+gc_root(void *slot) {
+  bool locked = gc_lock();
+  if (_gc.nroots == _gc.rootcap) {
+    _gc.rootcap = _gc.rootcap ? _gc.rootcap * 2 : 64;
+    _gc.roots = realloc(_gc.roots, _gc.rootcap * sizeof(void **));
+    if (_gc.roots == NULL) {
+      exit(1);
+    }
+  }
+  _gc.roots[_gc.nroots++] = slot;
+  gc_unlock(locked);
 }
 
+/* roots tend to be unrooted newest first, so look from the end */
+void
+gc_unroot(void *slot) {
+  bool locked = gc_lock();
+  for (size_t i = _gc.nroots; i-- > 0;) {
+    if (_gc.roots[i] == slot) {
+      _gc.roots[i] = _gc.roots[--_gc.nroots];
+      break;
+    }
+  }
+  gc_unlock(locked);
+}
+
+/* a cell can't leave the nursery, so removing one sets its removed
+bit instead, which gc_unmark leaves alone; it stays put until it's
+freed with list_free or envobj_free */
 void
 gc_remove(void *obj) {
-  ref *r1 = remove_unmarked(obj);
-  if (r1 != NULL) {
-    free(r1);
+  bool locked = gc_lock();
+  if (cell_live(obj)) {
+    cell_remove(obj);
+    gc_unlock(locked);
+    return;
   }
-  ref *r2 = remove_marked(obj);
-  if (r2 != NULL) {
-    free(r2);
+  ref *r = lookup(obj);
+  if (r != NULL) {
+    removeref((size_t)(r - _gc.refs));
   }
+  gc_unlock(locked);
 }
 
 void
 gc_mark(void *obj) {
-  ref *r = remove_unmarked(obj); 
-  append_marked(r);
+  bool locked = gc_lock();
+  if (cell_live(obj)) {
+    cell_pin(obj, true);
+    gc_unlock(locked);
+    return;
+  }
+  ref *r = lookup(obj);
+  if (r != NULL) {
+    r->marked = true;
+  }
+  gc_unlock(locked);
 }
 
 void
 gc_unmark(void *obj) {
-  ref *r = remove_marked(obj);
-  append_unmarked(r);
+  bool locked = gc_lock();
+  if (cell_pinned(obj)) {
+    cell_pin(obj, false);
+    ++_gc.unmarks;
+    gc_unlock(locked);
+    return;
+  }
+  ref *r = lookup(obj);
+  if (r != NULL && r->marked) {
+    r->marked = false;
+    ++_gc.unmarks;
+  }
+  gc_unlock(locked);
 }
 
-/* don't register objs twice; boy that could go poorly */
+/* registering an obj twice just updates its type */
 void
 gc_register(void *obj, TYPE type) {
-  ref *n = refitem(obj, type);
-  append_unmarked(n); 
+  bool locked = gc_lock();
+  uint32_t *tag = slab_tag(obj);
+  slot *s = NULL;
+  ref *r;
+  grow(tag == NULL);
+  if (tag != NULL) {
+    r = lookup(obj);
+  }
+  else {
+    s = &_gc.index[findslot(obj)];
+    r = s->ptr != NULL ? &_gc.refs[s->pos] : NULL;
+  }
+  if (r != NULL) {
+    r->type = type;
+  }
+  else {
+    r = &_gc.refs[_gc.count++];
+    r->ptr = obj;
+    r->type = type;
+    r->marked = false;
+    r->remembered = false;
+    r->tagged = tag != NULL;
+    if (tag != NULL) {
+      *tag = (uint32_t)_gc.count;
+    }
+    else {
+      s->ptr = obj;
+      s->pos = _gc.count - 1;
+      ++_gc.nhashed;
+    }
+    /* it's new, so it may well point at young cells */
+    if (_gc.tracer_table[type] != NULL) {
+      r->remembered = true;
+      remember(obj);
+    }
+  }
+  gc_unlock(locked);
+}
+
+/* list nodes and envobjs come from here instead of being registered */
+void *
+gc_alloc_cell(TYPE type) {
+  bool locked = gc_lock();
+  void *p = cell_alloc(type);
+  gc_unlock(locked);
+  return p;
+}
+
+/* false if p isn't a cell, so the caller can free it some other way */
+bool
+gc_free_cell(void *p) {
+  bool locked = gc_lock();
+  bool cell = cell_live(p);
+  if (cell) {
+    cell_free(p);
+  }
+  gc_unlock(locked);
+  return cell;
+}
+
+/* call after storing a pointer into obj, when obj may be older than
+what it now points at (next in an old list node, a closure's env...).
+the library does this itself; you only need it when you write into
+gc'd objs by hand */
+void
+gc_barrier(void *obj) {
+  bool locked = gc_lock();
+  if (cell_live(obj)) {
+    if (cell_old(obj) && cell_remember(obj)) {
+      remember(obj);
+    }
+  }
+  else {
+    ref *r = lookup(obj);
+    /* leaves have nothing to trace, so there's nothing to remember */
+    if (r != NULL && !r->remembered && _gc.tracer_table[r->type] != NULL) {
+      r->remembered = true;
+      remember(obj);
+    }
+  }
+  gc_unlock(locked);
+}
+
+/* collects young cells only.  the trace starts from the root slots,
+the pinned young cells and whatever's on the remembered set, and
+never goes past an old obj, so the cost is in the live young cells
+(and the remembered set), not the heap.  young cells that survive are
+promoted. */
+void
+gc_collect_minor(void) {
+  futures_pause();
+  bool locked = gc_lock();
+  cell_clear_marks(true);
+  cell_each_pinned(true, pushcell);
+  for (size_t i = 0; i < _gc.nroots; ++i) {
+    visit_young(*_gc.roots[i]);
+  }
+  for (size_t i = 0; i < _gc.nrem; ++i) {
+    void *obj = _gc.remset[i];
+    if (cell_remembered(obj)) {
+      _gc.tracer_table[cell_type(obj)](obj, visit_young);
+      continue;
+    }
+    ref *r = lookup(obj);
+    if (r != NULL && r->remembered && _gc.tracer_table[r->type] != NULL) {
+      _gc.tracer_table[r->type](obj, visit_young);
+    }
+  }
+  drain(visit_young);
+  forget_all();
+  cell_sweep(true);
+  gc_unlock(locked);
+  futures_resume();
 }
 
 void *
@@ -192,55 +627,341 @@ gc_malloc(size_t size, TYPE type) {
   return ptr;
 }
 
+/* trace, then take the refs that weren't reached out of the table and
+put them on the dead list.  nothing's destroyed yet, so destructors
+are free to call back into the gc when they do run.  dead cells don't
+need destructors, so they're swept here and then */
+static void
+detach(void) {
+  trace();
+  _gc.ndead = _gc.swept = 0;
+  /* from the end, so whatever removeref moves into k was already seen */
+  for (size_t k = _gc.count; k-- > 0;) {
+    if (_gc.refs[k].reached) {
+      continue;
+    }
+    if (_gc.ndead == _gc.deadcap) {
+      _gc.deadcap = _gc.deadcap ? _gc.deadcap * 2 : 256;
+      _gc.dead = realloc(_gc.dead, _gc.deadcap * sizeof(ref));
+      if (_gc.dead == NULL) {
+        exit(1);
+      }
+    }
+    _gc.dead[_gc.ndead++] = _gc.refs[k];
+    removeref(k);
+  }
+  forget_all();
+  cell_sweep(false);
+}
+
+static void
+destroy_next(void) {
+  ref *r = &_gc.dead[_gc.swept++];
+  (*(_gc.destructor_table[r->type]))(r->ptr);
+}
+
+/* the last of the dead list is gone */
+static void
+finish(void) {
+  _gc.ndead = _gc.swept = 0;
+  slab_trim(); /* whole empty slabs go back in bulk */
+}
+
+static long
+since_us(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* the dead list goes to the sweeper as it is: the gc just starts a new
+one, so this doesn't depend on how much garbage there is.
+
+from here on the destructors run on the sweeper while this thread
+carries on allocating, and that's only safe because both sides take
+the gc's and the slabs' locks.  the sweeper always does (sweeploop
+sets that up), and everyone else does because gc_start_sweeper's
+gc_enter_parallel keeps parallel above 0 until gc_stop_sweeper has
+joined the thread.  don't let that count drop while it runs.  nothing
+on a dead list is a future that's still going: those are roots until
+complete() runs, so its body can't be destroyed out from under it */
+static void
+handoff(void) {
+  if (_gc.ndead == 0) {
+    return;
+  }
+  sweepbatch *b = malloc(sizeof(sweepbatch));
+  if (b == NULL) {
+    exit(1);
+  }
+  b->dead = _gc.dead;
+  b->ndead = _gc.ndead;
+  b->next = NULL;
+  _gc.dead = NULL;
+  _gc.ndead = _gc.deadcap = _gc.swept = 0;
+  atomic_fetch_add(&_sweeper.queued, b->ndead);
+  pthread_mutex_lock(&_sweeper.lock);
+  if (_sweeper.tail != NULL) {
+    _sweeper.tail->next = b;
+  }
+  else {
+    _sweeper.head = b;
+  }
+  _sweeper.tail = b;
+  pthread_cond_signal(&_sweeper.work);
+  pthread_mutex_unlock(&_sweeper.lock);
+}
+
+static void *
+sweeploop(void *unused) {
+  sweeper_thread = true; /* lock whatever parallel says */
+  slab_lock_always();
+  pthread_mutex_lock(&_sweeper.lock);
+  for (;;) {
+    while (_sweeper.head == NULL && !_sweeper.quit) {
+      pthread_cond_wait(&_sweeper.work, &_sweeper.lock);
+    }
+    sweepbatch *b = _sweeper.head;
+    if (b == NULL) {
+      break; /* told to quit, and there's nothing left */
+    }
+    _sweeper.head = b->next;
+    if (_sweeper.head == NULL) {
+      _sweeper.tail = NULL;
+    }
+    _sweeper.busy = true;
+    pthread_mutex_unlock(&_sweeper.lock);
+    for (size_t k = 0; k < b->ndead; ++k) {
+      (*(_gc.destructor_table[b->dead[k].type]))(b->dead[k].ptr);
+      atomic_fetch_add_explicit(&_sweeper.swept, 1, memory_order_relaxed);
+    }
+    free(b->dead);
+    free(b);
+    slab_trim();
+    pthread_mutex_lock(&_sweeper.lock);
+    _sweeper.busy = false;
+    if (_sweeper.head == NULL) {
+      pthread_cond_broadcast(&_sweeper.idle);
+    }
+  }
+  pthread_mutex_unlock(&_sweeper.lock);
+  return NULL;
+}
+
+static size_t
+outstanding(void) {
+  return atomic_load(&_sweeper.queued) - atomic_load(&_sweeper.swept);
+}
+
+/* a whole collect in one go.  if a destructor unmarks something there's
+another round, so that goes in the same collect.  anything gc_collect_step
+left on the dead list is finished off first.
+
+with the sweeper running, it's the trace, then the dead list is handed
+over and gc_collect returns without running any destructors.  the gc is
+locked while it traces, since the sweeper's destructors may call in.
+an unmark from one of those is picked up by the next collect.
+
+either way the trace waits for future bodies that are running to
+return (futures_pause), and none start until it's done */
 void
 gc_collect(void) {
-  ref *curr = _gc.unmarked;
-  while (curr != NULL) {
-    ref *next = curr->next;
-    (*(_gc.destructor_table[curr->type]))(curr->ptr);
-    free(curr);
-    curr = next;   
+  size_t unmarks;
+  bool locked;
+  if (_sweeper.running) {
+    futures_pause();
+    locked = gc_lock();
+    detach();
+    gc_unlock(locked);
+    futures_resume();
+    handoff();
+    return;
+  }
+  while (_gc.swept < _gc.ndead) {
+    destroy_next();
+  }
+  do {
+    futures_pause();
+    locked = gc_lock();
+    detach();
+    gc_unlock(locked);
+    futures_resume();
+    unmarks = _gc.unmarks;
+    while (_gc.swept < _gc.ndead) {
+      destroy_next();
+    }
+  } while (_gc.unmarks != unmarks);
+  finish();
+}
+
+/* the same collect in pieces, for callers that can't stop for all of
+it.  when there's nothing left over from last time, this traces and
+detaches the garbage (that part isn't split up), and then it runs
+destructors until budget_us microseconds have gone by since the call,
+checking the clock every GC_STEP_BATCH of them; at least one batch
+is done each call.  returns how many dead objs are still waiting, so
+0 means this collect is over and the next call starts another */
+size_t
+gc_collect_step(long budget_us) {
+  struct timespec start;
+  if (_sweeper.running) {
+    /* the sweeper does the destructors; all that's left here is to start
+    a collect once it's caught up */
+    if (outstanding() == 0) {
+      gc_collect();
+    }
+    return outstanding();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (_gc.swept == _gc.ndead) {
+    futures_pause();
+    bool locked = gc_lock();
+    detach();
+    gc_unlock(locked);
+    futures_resume();
+  }
+  while (_gc.swept < _gc.ndead) {
+    for (size_t i = 0; i < GC_STEP_BATCH && _gc.swept < _gc.ndead; ++i) {
+      destroy_next();
+    }
+    if (since_us(&start) >= budget_us) {
+      break;
+    }
+  }
+  if (_gc.swept == _gc.ndead) {
+    finish();
+  }
+  return _gc.ndead - _gc.swept;
+}
+
+/* starts the sweeper thread.  the gc and the slabs lock from here on
+(as they do for any other parallel stretch), since the sweeper frees
+into them while the program carries on; the parallel stretch lasts
+until gc_stop_sweeper (see handoff) */
+void
+gc_start_sweeper(void) {
+  if (_sweeper.running) {
+    return;
+  }
+  while (_gc.swept < _gc.ndead) {
+    destroy_next();
+  }
+  finish();
+  gc_enter_parallel();
+  _sweeper.quit = false;
+  _sweeper.running = true;
+  if (pthread_create(&_sweeper.thread, NULL, sweeploop, NULL) != 0) {
+    exit(1);
+  }
+}
+
+/* waits for everything handed over so far to be destroyed */
+void
+gc_sweep_wait(void) {
+  pthread_mutex_lock(&_sweeper.lock);
+  while (_sweeper.head != NULL || _sweeper.busy) {
+    pthread_cond_wait(&_sweeper.idle, &_sweeper.lock);
+  }
+  pthread_mutex_unlock(&_sweeper.lock);
+}
+
+/* the sweeper finishes what it has before it goes */
+void
+gc_stop_sweeper(void) {
+  if (!_sweeper.running) {
+    return;
+  }
+  pthread_mutex_lock(&_sweeper.lock);
+  _sweeper.quit = true;
+  pthread_cond_signal(&_sweeper.work);
+  pthread_mutex_unlock(&_sweeper.lock);
+  pthread_join(_sweeper.thread, NULL);
+  _sweeper.running = false;
+  gc_leave_parallel();
+}
+
+/* queued counts every dead obj ever handed to the sweeper, swept the
+ones it's destroyed; queued - swept is what it's still got to do */
+void
+gc_sweep_stats(gcstats *stats) {
+  stats->queued = atomic_load(&_sweeper.queued);
+  stats->swept = atomic_load(&_sweeper.swept);
+}
+
+/* bracket any stretch where threads other than the caller may create
+or register objects; gc_collect itself must not run during one */
+void
+gc_enter_parallel(void) {
+  atomic_fetch_add(&parallel, 1);
+  slab_enter_parallel();
+}
+
+void
+gc_leave_parallel(void) {
+  slab_leave_parallel();
+  atomic_fetch_sub(&parallel, 1);
+}
+
+static void
+print_ref(ref *r) {
+  switch(r->type) {
+    case LIST:
+      printf("LIST at %p\n", r->ptr);
+    break;
+    case STANDARD:
+      printf("STANDARD at %p\n", r->ptr);
+    break;
+    case ENVOBJ:
+      printf("ENVOBJ at %p\n", r->ptr);
+    break;
+    case CLOSURE:
+      printf("CLOSURE at %p\n", r->ptr);
+    break;
+    case BOXED:
+      printf("BOXED at %p\n", r->ptr);
+    break;
+    case VECTOR:
+      printf("VECTOR at %p\n", r->ptr);
+    break;
+    case FCLOSURE:
+      printf("FCLOSURE at %p\n", r->ptr);
+    break;
+    case FUTURE:
+      printf("FUTURE at %p\n", r->ptr);
+    break;
+    case UCHUNK:
+      printf("UCHUNK at %p\n", r->ptr);
+    break;
+    case STREAM:
+      printf("STREAM at %p\n", r->ptr);
+    break;
+    case PVECTOR:
+      printf("PVECTOR at %p\n", r->ptr);
+    break;
+    case MEMO:
+      printf("MEMO at %p\n", r->ptr);
+    break;
   }
-  _gc.unmarked = NULL;
 }
 
 /* displays everything inside the garbage collector
 for debugging purposes */
 void
 gc_print(void) {
-  ref *curr;
+  size_t young, old;
+  cell_counts(&young, &old);
+  printf("NURSERY: %zu young cells, %zu old cells\n", young, old);
+  printf("WAITING ON DESTRUCTORS: %zu\n", _gc.ndead - _gc.swept + outstanding());
   printf("TO BE COLLECTED (UNMARKED):\n");
-  for (curr = _gc.unmarked; curr != NULL; curr = curr->next) {
-    switch(curr->type) {
-      case LIST:
-        printf("LIST at %p\n", curr->ptr);
-      break;
-      case STANDARD:
-        printf("STANDARD at %p\n", curr->ptr);
-      break;
-      case ENVOBJ:
-        printf("ENVOBJ at %p\n", curr->ptr);
-      break;
-      case CLOSURE:
-        printf("CLOSURE at %p\n", curr->ptr);
-      break; 
+  for (size_t k = 0; k < _gc.count; ++k) {
+    if (!_gc.refs[k].marked) {
+      print_ref(&_gc.refs[k]);
     }
   }
   printf("MARKED FOR SAFE KEEPING:\n");
-  for (curr = _gc.marked; curr != NULL; curr = curr->next) {
-    switch(curr->type) {
-      case LIST:
-        printf("LIST at %p\n", curr->ptr);
-      break;
-      case STANDARD:
-        printf("STANDARD at %p\n", curr->ptr);
-      break;
-      case ENVOBJ:
-        printf("ENVOBJ at %p\n", curr->ptr);
-      break;
-      case CLOSURE:
-        printf("CLOSURE at %p\n", curr->ptr);
-      break; 
+  for (size_t k = 0; k < _gc.count; ++k) {
+    if (_gc.refs[k].marked) {
+      print_ref(&_gc.refs[k]);
     }
   }
 }
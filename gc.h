@@ -1,21 +1,54 @@
 #ifndef GC_H
 #define GC_H
 #include <stdlib.h>
+#include <stdbool.h>
 typedef enum TYPE {
   LIST,
   ENVOBJ,  
   CLOSURE,
-  STANDARD //gc's an generic obj   
+  STANDARD, //gc's an generic obj   
+  BOXED, //a boxed int from the slab allocator
+  VECTOR,
+  FCLOSURE, //a flat closure, env and all
+  FUTURE,
+  UCHUNK, //a chunk of a ulist
+  STREAM,
+  PVECTOR, //a vector of pointers, which the gc follows
+  MEMO //a memoize cache
 } TYPE;
 
-#define TYPE_COUNT 4
+#define TYPE_COUNT 12
+
+/* how many destructors gc_collect_step runs between looks at the clock */
+#ifndef GC_STEP_BATCH
+#define GC_STEP_BATCH 32
+#endif
+
+/* what the background sweeper has been given and gotten through */
+typedef struct gcstats {
+  size_t queued;
+  size_t swept;
+} gcstats;
 
 void gc_mark(void *obj);
 void gc_unmark(void *obj);
 void gc_register(void *obj, TYPE type);
 void *gc_malloc(size_t size, TYPE type);
 void gc_remove(void *obj);
+void gc_root(void *slot);
+void gc_unroot(void *slot);
 void gc_init(void);
 void gc_collect(void);
+void gc_collect_minor(void);
+size_t gc_collect_step(long budget_us);
+void gc_start_sweeper(void);
+void gc_stop_sweeper(void);
+void gc_sweep_wait(void);
+void gc_sweep_stats(gcstats *stats);
+void *gc_alloc_cell(TYPE type);
+bool gc_free_cell(void *p);
+void gc_barrier(void *obj);
 void gc_print(void);
+void gc_enter_parallel(void);
+void gc_leave_parallel(void);
 #endif
@@ -3,25 +3,23 @@
 #include <stdbool.h>
 #include "list.h"
 #include "gc.h"
+#include "slab.h"
 
+static slabpool listpool = SLABPOOL_INIT(sizeof(list));
+
+/* nodes are nursery cells (see gc.h); copyitem's aren't gc'd at all,
+so they still come from the slab */
 list *
 newitem(void *v) {
-  list *o = malloc(sizeof(list));
-  if (o == NULL) {
-    exit(1);
-  }
+  list *o = gc_alloc_cell(LIST);
   o->val = v;
   o->next = NULL;
-  gc_register((void *)o, LIST);
   return o;
 }
 
 list *
 copyitem(list *i) {
-  list *o = malloc(sizeof(list));
-  if (o == NULL) {
-    exit(1);
-  }
+  list *o = slab_alloc(&listpool);
   o->val = i->val;
   o->next = NULL;
   return o;
@@ -37,6 +35,7 @@ append(list *l, void *v) {
   for (curr = l; curr->next != NULL; curr = curr->next)
     ;
   curr->next = ni;
+  gc_barrier(curr);
   return l;
 }
 
@@ -46,25 +45,36 @@ concat(list *h, list *t) {
   for (curr = h; curr->next != NULL; curr = curr->next)
     ;
   curr->next = t;
+  gc_barrier(curr);
   return h; 
 }
 
 /*shallow copy*/
 list *
 copy(list *l) {
-  list *o = NULL;
+  listbuilder b;
   list *curr;
+  builder_init(&b);
   for (curr = l; curr != NULL; curr = curr->next) {
-    o = append(o, curr->val);
+    builder_append(&b, curr->val);
   }
-  return o; 
+  return builder_list(&b); 
 }
 
 /*objs flag set to true will also free the objects in the list*/
 void
 list_free(void *_l) {
+  if (!gc_free_cell(_l)) {
+    slab_free(_l); 
+  }
+}
+
+/* for the gc: a node points at its val and the next node */
+void
+list_trace(void *_l, void (*visit)(void *)) {
   list *l = _l;
-  free(l); 
+  visit(l->val);
+  visit(l->next);
 }
 
 /* Haskell-style operations */
@@ -77,13 +87,63 @@ last(list *l) {
   return cursor->val;
 }
 
-/* Not sure what's best to do with the leftover node, so freeing it for now. */
+/* The leftover node is still registered with the gc, so it's left for gc_collect. */
 list *
 init(list *l) {
   list *cursor;
   for(cursor=l; cursor->next->next != NULL; cursor = cursor->next)
     ;
-  free(cursor->next);
   cursor->next = NULL;
   return l;
-}
\ No newline at end of file
+}
+
+/* list builders: use these instead of append in loops */
+void
+builder_init(listbuilder *b) {
+  b->head = NULL;
+  b->last = NULL;
+  b->length = 0;
+  b->fresh = true;
+}
+
+void
+builder_append(listbuilder *b, void *v) {
+  list *ni = newitem(v);
+  if (b->head == NULL) {
+    b->head = ni;
+  }
+  else {
+    b->last->next = ni;
+    if (!b->fresh) {
+      gc_barrier(b->last);
+    }
+  }
+  b->last = ni;
+  b->fresh = true;
+  b->length++;
+}
+
+/* links t onto the end of the builder; t is walked once to find its tail */
+void
+builder_concat(listbuilder *b, list *t) {
+  if (t == NULL) {
+    return;
+  }
+  if (b->head == NULL) {
+    b->head = t;
+  }
+  else {
+    b->last->next = t;
+    gc_barrier(b->last);
+  }
+  b->fresh = false;
+  b->length++;
+  for (b->last = t; b->last->next != NULL; b->last = b->last->next) {
+    b->length++;
+  }
+}
+
+list *
+builder_list(listbuilder *b) {
+  return b->head;
+}
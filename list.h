@@ -1,6 +1,7 @@
 #ifndef LIST_H
 #define LIST_H
 #include <stdbool.h>
+#include <stddef.h>
 
 /* our list type that we'll use throughout 
 along with the helper functions: newitem and append
@@ -10,17 +11,32 @@ typedef struct list_ {
   struct list_ *next;
 } list;
 
+/* a list under construction: remembers its last node so that
+appending is O(1) instead of a walk to the tail every time */
+typedef struct listbuilder {
+  list *head;
+  list *last;
+  size_t length;
+  bool fresh; /* last was made by builder_append, so it's young */
+} listbuilder;
+
 list *newitem(void *v); 
 list *copyitem(list *i); 
 list *append(list *l, void *v); 
 list *concat(list *h, list *t); 
 list *copy(list *h); 
 void list_free(void *); 
+void list_trace(void *, void (*)(void *));
 #define head(list) ((list)->val) /* no point in doing these as functions */
 #define tail(list) ((list)->next)
 void *last(list *l);
 list *init(list *l);
 
+void builder_init(listbuilder *b);
+void builder_append(listbuilder *b, void *v);
+void builder_concat(listbuilder *b, list *t);
+list *builder_list(listbuilder *b);
+
 
 #endif
 
@@ -4,6 +4,9 @@
 #include "functional.h"
 #include "closure.h"
 #include "gc.h"
+#include "tagged.h"
+#include "stream.h"
+#include "trampoline.h"
 
 /* a function to play with iter */
 void
@@ -26,6 +29,17 @@ dbl(void *v, void *args) {
   return o;
 }
 
+/* the same two, on tagged ints: no mallocs anywhere */
+void
+tprintint(int v, void *args) {
+  printf("%d\n", v);
+}
+
+int
+tdbl(int v, void *args) {
+  return v * 2;
+}
+
 /* we'll use this to play with closures */
 void *
 add(list *l) {
@@ -36,6 +50,35 @@ add(list *l) {
   return o; 
 }
 
+/* and again, writing the sum where we're told to: nothing to malloc */
+void
+addinto(list *l, void *out, size_t size) {
+  *(int *)out = *(int *)unbox(l) + *(int *)unbox(l->next);
+}
+
+/* the same thing as a flat closure: the captured value is just env_get */
+void *
+fadd(fclosure *c, envobj *x) {
+  int *o = malloc(sizeof(int));
+  *o = *(int *)env_get(c, 0)->val + *(int *)x->val;
+  return o;
+}
+
+/* sumList from algebraic/README.md, written as a tail call so the
+trampoline can run it on any length of list.  env is [NULL, acc, l]
+(the NULL is what bind put there) */
+void *
+sumlist(list *env) {
+  long acc = (long)unbox(env->next);
+  list *l = unbox(env->next->next);
+  if (l == NULL) {
+    return (void *)acc;
+  }
+  return tailcall2(current_closure(),
+                   tcarg(0, (void *)(acc + intval(l->val)), 0),
+                   tcarg(1, l->next, 0));
+}
+
 int
 main(int argc, char **argv) {
   
@@ -43,6 +86,8 @@ main(int argc, char **argv) {
 
   iter(map(range(0, 10), dbl, NULL), printint, NULL);
   iter(filter(range(0, 10), odd, NULL), printint, NULL); 
+  titer(tmap(trange(0, 10), tdbl, NULL), tprintint, NULL);
+  siter(smap(sfilter(from_range(0, 10), odd, NULL), dbl, NULL), printint, NULL);
   
   /* Darker magic?  Not really... */
   closure *addtwo = bind(NULL, add, liftint(2));
@@ -56,6 +101,20 @@ main(int argc, char **argv) {
   list *res = lmap(vars, addtwo);
   iter(res, printint, NULL);
 
+  fclosure *faddtwo = fbind(newfclosure(fadd, 1), liftint(2));
+  iter(flmap(vars, faddtwo), printint, NULL);
+
+  int sums[11];
+  closure *addthree = bind_into(NULL, addinto, sizeof(int), liftint(3));
+  size_t nsums = lmap_into(vars, addthree, sums, sizeof(int));
+  for (size_t i = 0; i < nsums; ++i) {
+    printf("%d\n", sums[i]);
+  }
+
+  /* a million deep, and not a stack frame more than one */
+  closure *sum = bind(NULL, sumlist, NULL);
+  printf("%ld\n", (long)trampoline2(sum, tcarg(0, (void *)0, 0), tcarg(1, trange(1, 1000000), 0)));
+
   gc_print(); /* show eveything currently in the garbage collector */
 
   gc_collect(); /* you can guess what this does */
@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "list.h"
+#include "closure.h"
+#include "memo.h"
+#include "gc.h"
+
+/* the entries live in a fixed array that the clock hand sweeps; index
+maps hashes to entries with linear probing (-1 is empty) */
+typedef struct entry {
+  uint64_t hash;
+  char *key;
+  size_t keylen;
+  envobj *arg;  /* kept so the pointers in the key stay what they were */
+  void *result;
+  bool referenced;
+} entry;
+
+typedef struct memo {
+  closure *cl;
+  entry *entries;
+  size_t count;
+  size_t capacity;
+  size_t hand;
+  long *index;
+  size_t indexsize;
+  memostats stats;
+  bool threadsafe;
+  pthread_mutex_t lock;
+} memo;
+
+/* keys are built in a local buffer when they fit */
+#define KEYBUF 256
+
+static void
+keyput(char **key, size_t *len, size_t *cap, char *local, const void *p, size_t n) {
+  if (*len + n > *cap) {
+    size_t cap2 = (*len + n) * 2;
+    char *k = malloc(cap2);
+    if (k == NULL) {
+      exit(1);
+    }
+    memcpy(k, *key, *len);
+    if (*key != local) {
+      free(*key);
+    }
+    *key = k;
+    *cap = cap2;
+  }
+  memcpy(*key + *len, p, n);
+  *len += n;
+}
+
+static void
+keyenv(char **key, size_t *len, size_t *cap, char *local, envobj *e) {
+  if (e == NULL) {  /* bind(NULL, fn, NULL) leaves one of these */
+    keyput(key, len, cap, local, &e, sizeof(e));
+    return;
+  }
+  keyput(key, len, cap, local, &e->size, sizeof(e->size));
+  if (e->size > 0) {
+    keyput(key, len, cap, local, e->val, e->size);
+  }
+  else {
+    keyput(key, len, cap, local, &e->val, sizeof(e->val));
+  }
+}
+
+static uint64_t
+keyhash(const char *key, size_t len) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ (unsigned char)key[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+/* the slot in index holding hash/key, or the empty slot where it would go */
+static size_t
+probe(memo *m, uint64_t h, const char *key, size_t len) {
+  size_t mask = m->indexsize - 1;
+  size_t i = h & mask;
+  for (; m->index[i] >= 0; i = (i + 1) & mask) {
+    entry *e = &m->entries[m->index[i]];
+    if (e->hash == h && e->keylen == len && memcmp(e->key, key, len) == 0) {
+      break;
+    }
+  }
+  return i;
+}
+
+/* backward shift deletion, so probe chains stay unbroken */
+static void
+unindex(memo *m, size_t i) {
+  size_t mask = m->indexsize - 1;
+  size_t j = i;
+  for (;;) {
+    m->index[i] = -1;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (m->index[j] < 0) {
+        return;
+      }
+      size_t home = m->entries[m->index[j]].hash & mask;
+      /* can j's entry move back to i? only if i lies between its home and j */
+      if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+        break;
+      }
+    }
+    m->index[i] = m->index[j];
+    i = j;
+  }
+}
+
+/* a free entry: a new one while there's room, otherwise the first one
+the clock hand finds without its referenced bit, which gets evicted */
+static size_t
+victim(memo *m) {
+  if (m->count < m->capacity) {
+    return m->count++;
+  }
+  for (;;) {
+    entry *e = &m->entries[m->hand];
+    size_t at = m->hand;
+    m->hand = (m->hand + 1) % m->capacity;
+    if (e->referenced) {
+      e->referenced = false;
+      continue;
+    }
+    unindex(m, probe(m, e->hash, e->key, e->keylen));
+    free(e->key);
+    ++m->stats.evictions;
+    return at;
+  }
+}
+
+static void
+memolock(memo *m) {
+  if (m->threadsafe) {
+    pthread_mutex_lock(&m->lock);
+  }
+}
+
+static void
+memounlock(memo *m) {
+  if (m->threadsafe) {
+    pthread_mutex_unlock(&m->lock);
+  }
+}
+
+/* the body of a memoized closure: env is [the memo, the argument] */
+static void *
+memocall(list *env) {
+  memo *m = unbox(env);
+  envobj *arg = (envobj *)env->next->val;
+  char local[KEYBUF], *key = local;
+  size_t len = 0, cap = KEYBUF;
+  list *curr;
+
+  for (curr = m->cl->env; curr != NULL; curr = curr->next) {
+    keyenv(&key, &len, &cap, local, (envobj *)curr->val);
+  }
+  keyenv(&key, &len, &cap, local, arg);
+  uint64_t h = keyhash(key, len);
+
+  memolock(m);
+  size_t i = probe(m, h, key, len);
+  if (m->index[i] >= 0) {
+    entry *e = &m->entries[m->index[i]];
+    void *result = e->result;
+    e->referenced = true;
+    ++m->stats.hits;
+    memounlock(m);
+    if (key != local) {
+      free(key);
+    }
+    return result;
+  }
+  ++m->stats.misses;
+  memounlock(m);
+
+  void *result = call(m->cl, arg);
+
+  memolock(m);
+  /* someone else may have put it in while we were computing */
+  i = probe(m, h, key, len);
+  if (m->index[i] < 0) {
+    size_t at = victim(m);
+    entry *e = &m->entries[at];
+    e->hash = h;
+    e->keylen = len;
+    e->key = malloc(len > 0 ? len : 1);
+    if (e->key == NULL) {
+      exit(1);
+    }
+    memcpy(e->key, key, len);
+    e->arg = arg;
+    e->result = result;
+    e->referenced = false;
+    gc_barrier(m); /* m is likely older than arg and result */
+    m->index[probe(m, h, key, len)] = (long)at;
+  }
+  memounlock(m);
+  if (key != local) {
+    free(key);
+  }
+  return result;
+}
+
+closure *
+memoize_opts(closure *c, size_t capacity, bool threadsafe) {
+  if (capacity == 0) {
+    exit(1);
+  }
+  memo *m = gc_malloc(sizeof(memo), MEMO);
+  m->cl = c;
+  m->capacity = capacity;
+  m->count = 0;
+  m->hand = 0;
+  m->entries = malloc(capacity * sizeof(entry));
+  m->indexsize = 1;
+  while (m->indexsize < 2 * capacity) {
+    m->indexsize *= 2;
+  }
+  m->index = malloc(m->indexsize * sizeof(long));
+  if (m->entries == NULL || m->index == NULL) {
+    exit(1);
+  }
+  for (size_t i = 0; i < m->indexsize; ++i) {
+    m->index[i] = -1;
+  }
+  memset(&m->stats, 0, sizeof(memostats));
+  m->threadsafe = threadsafe;
+  pthread_mutex_init(&m->lock, NULL);
+  return bind(NULL, memocall, envitem((void *)m, 0));
+}
+
+closure *
+memoize(closure *c) {
+  return memoize_opts(c, MEMO_CAPACITY, false);
+}
+
+void
+memo_stats(closure *mc, memostats *stats) {
+  memo *m = unbox(mc->env);
+  memolock(m);
+  *stats = m->stats;
+  memounlock(m);
+}
+
+/* for the gc: the memo keeps the closure it wraps, and every cached
+argument and result */
+void
+memo_trace(void *_m, void (*visit)(void *)) {
+  memo *m = _m;
+  visit(m->cl);
+  for (size_t i = 0; i < m->count; ++i) {
+    visit(m->entries[i].arg);
+    visit(m->entries[i].result);
+  }
+}
+
+void
+memo_destroy(void *_m) {
+  memo *m = _m;
+  for (size_t i = 0; i < m->count; ++i) {
+    free(m->entries[i].key);
+  }
+  free(m->entries);
+  free(m->index);
+  pthread_mutex_destroy(&m->lock);
+  free(m);
+}
+
+/* frees the cache now instead of waiting for the gc to find mc
+unreachable; mc itself is the gc's like any other closure, and
+mustn't be called again */
+void
+memo_free(closure *mc) {
+  memo *m = unbox(mc->env);
+  gc_remove(m);
+  memo_destroy(m);
+}
@@ -0,0 +1,35 @@
+#ifndef MEMO_H
+#define MEMO_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "closure.h"
+
+/* memoization for pure closures.  memoize(c) returns a new closure that
+looks the argument up in a bounded cache before calling c; the key is
+the argument's bytes together with the bytes of c's env, so binding
+more onto c later doesn't hand back stale results.  envobjs with a size
+of 0 or less are keyed on the pointer itself (tagged ints, say).  when
+the cache is full, entries are evicted CLOCK style.
+
+the cache is a gc object (a MEMO) that the memoized closure's env
+points at.  while the memoized closure is reachable, so are the
+closure it wraps and every cached argument and result, and a result
+that's evicted is just one pointer fewer to it.  the gc frees the
+cache along with the memoized closure; memo_free does it sooner. */
+#define MEMO_CAPACITY 1024
+
+typedef struct memostats {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+} memostats;
+
+closure *memoize(closure *c);
+/* threadsafe puts a mutex around the cache, for pmap and friends */
+closure *memoize_opts(closure *c, size_t capacity, bool threadsafe);
+void memo_stats(closure *m, memostats *stats);
+void memo_free(closure *m);
+void memo_trace(void *, void (*)(void *));
+void memo_destroy(void *);
+
+#endif
@@ -0,0 +1,391 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "gc.h"
+#include "list.h"
+#include "closure.h"
+#include "nursery.h"
+
+#define CHUNK_CELLS (NURSERY_CHUNK / CELL_SIZE)
+#define CELL_WORDS (CHUNK_CELLS / 64)
+
+typedef struct nchunk nchunk;
+struct nchunk {
+  nchunk *next;
+  bool dirty;     /* has young or remembered cells; it's in _n.dirty */
+  uint64_t used[CELL_WORDS];
+  uint64_t old[CELL_WORDS];
+  uint64_t mark[CELL_WORDS];
+  uint64_t pinned[CELL_WORDS];
+  uint64_t removed[CELL_WORDS]; /* gc_remove'd: kept, whatever the pins say */
+  uint64_t remembered[CELL_WORDS];
+  unsigned char type[CHUNK_CELLS];
+};
+
+/* cells start after the header */
+#define FIRST_CELL ((sizeof(nchunk) + CELL_SIZE - 1) / CELL_SIZE)
+
+_Static_assert(sizeof(list) == CELL_SIZE, "list nodes must fit a cell");
+_Static_assert(sizeof(envobj) == CELL_SIZE, "envobjs must fit a cell");
+
+#define BIT(map, i) (((map)[(i) / 64] >> ((i) % 64)) & 1)
+#define SET(map, i) ((map)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define CLEAR(map, i) ((map)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+
+static struct {
+  nchunk *head;
+  nchunk *tail;
+  nchunk *cur;    /* where the cursor is */
+  size_t cell;    /* and which cell it's on */
+  nchunk **set;   /* every chunk, hashed on its address, to tell if a pointer is a cell */
+  size_t setsize;
+  size_t nchunks;
+  nchunk **dirty; /* the chunks a minor collection has to look at */
+  size_t ndirty;
+  size_t dirtycap;
+} _n;
+
+static size_t
+chunkhash(nchunk *c) {
+  uint64_t h = (uint64_t)(uintptr_t)c / NURSERY_CHUNK;
+  return (size_t)(h * 0x9e3779b97f4a7c15ull >> 17);
+}
+
+static void
+setput(nchunk **set, size_t size, nchunk *c) {
+  size_t i = chunkhash(c) & (size - 1);
+  while (set[i] != NULL) {
+    i = (i + 1) & (size - 1);
+  }
+  set[i] = c;
+}
+
+static void
+rehash(size_t size) {
+  nchunk **set = calloc(size, sizeof(nchunk *));
+  if (set == NULL) {
+    exit(1);
+  }
+  for (nchunk *c = _n.head; c != NULL; c = c->next) {
+    setput(set, size, c);
+  }
+  free(_n.set);
+  _n.set = set;
+  _n.setsize = size;
+}
+
+/* the chunk p is a cell of, and its index there, or NULL */
+static nchunk *
+chunkof(void *p, size_t *index) {
+  uintptr_t a = (uintptr_t)p;
+  if (_n.setsize == 0 || a % CELL_SIZE != 0) {
+    return NULL;
+  }
+  nchunk *c = (nchunk *)(a & ~(uintptr_t)(NURSERY_CHUNK - 1));
+  size_t i = chunkhash(c) & (_n.setsize - 1);
+  for (; _n.set[i] != NULL; i = (i + 1) & (_n.setsize - 1)) {
+    if (_n.set[i] == c) {
+      *index = (a - (uintptr_t)c) / CELL_SIZE;
+      return *index >= FIRST_CELL ? c : NULL;
+    }
+  }
+  return NULL;
+}
+
+static nchunk *
+newchunk(void) {
+  nchunk *c = aligned_alloc(NURSERY_CHUNK, NURSERY_CHUNK);
+  if (c == NULL) {
+    exit(1);
+  }
+  memset(c, 0, sizeof(nchunk));
+  if (_n.tail != NULL) {
+    _n.tail->next = c;
+  }
+  else {
+    _n.head = c;
+  }
+  _n.tail = c;
+  ++_n.nchunks;
+  if (2 * _n.nchunks > _n.setsize) {
+    rehash(_n.setsize ? _n.setsize * 2 : 64);
+  }
+  else {
+    setput(_n.set, _n.setsize, c);
+  }
+  return c;
+}
+
+/* minor collections only go through the dirty chunks, so the old
+part of the heap costs them nothing */
+static void
+touch(nchunk *c) {
+  if (c->dirty) {
+    return;
+  }
+  if (_n.ndirty == _n.dirtycap) {
+    _n.dirtycap = _n.dirtycap ? _n.dirtycap * 2 : 64;
+    _n.dirty = realloc(_n.dirty, _n.dirtycap * sizeof(nchunk *));
+    if (_n.dirty == NULL) {
+      exit(1);
+    }
+  }
+  c->dirty = true;
+  _n.dirty[_n.ndirty++] = c;
+}
+
+/* the next unused cell at or after the cursor, a word of the bitmap at
+a time; a new chunk when the last one runs out */
+void *
+cell_alloc(TYPE type) {
+  for (;;) {
+    nchunk *c = _n.cur;
+    if (c == NULL) {
+      c = _n.cur = newchunk();
+      _n.cell = FIRST_CELL;
+    }
+    while (_n.cell < CHUNK_CELLS) {
+      size_t w = _n.cell / 64;
+      uint64_t freebits = ~c->used[w] & (~(uint64_t)0 << (_n.cell % 64));
+      if (freebits == 0) {
+        _n.cell = (w + 1) * 64;
+        continue;
+      }
+      size_t i = w * 64 + __builtin_ctzll(freebits);
+      _n.cell = i + 1;
+      SET(c->used, i);
+      c->type[i] = (unsigned char)type;
+      touch(c);
+      return (char *)c + i * CELL_SIZE;
+    }
+    _n.cur = c->next;
+    _n.cell = FIRST_CELL;
+    if (_n.cur == NULL) {
+      _n.cur = newchunk();
+    }
+  }
+}
+
+void
+cell_free(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  if (c != NULL) {
+    CLEAR(c->used, i);
+    CLEAR(c->old, i);
+    CLEAR(c->mark, i);
+    CLEAR(c->pinned, i);
+    CLEAR(c->removed, i);
+    CLEAR(c->remembered, i);
+  }
+}
+
+bool
+cell_live(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  return c != NULL && BIT(c->used, i);
+}
+
+TYPE
+cell_type(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  return (TYPE)c->type[i];
+}
+
+bool
+cell_old(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  return c != NULL && BIT(c->old, i);
+}
+
+bool
+cell_mark(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  if (c == NULL || !BIT(c->used, i) || BIT(c->mark, i)) {
+    return false;
+  }
+  SET(c->mark, i);
+  return true;
+}
+
+void
+cell_pin(void *p, bool on) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  if (c != NULL && on) {
+    SET(c->pinned, i);
+  }
+  else if (c != NULL) {
+    CLEAR(c->pinned, i);
+  }
+}
+
+bool
+cell_pinned(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  return c != NULL && BIT(c->pinned, i);
+}
+
+void
+cell_remove(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  if (c != NULL) {
+    SET(c->removed, i);
+  }
+}
+
+bool
+cell_remember(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  if (c == NULL || BIT(c->remembered, i)) {
+    return false;
+  }
+  SET(c->remembered, i);
+  touch(c);
+  return true;
+}
+
+bool
+cell_remembered(void *p) {
+  size_t i;
+  nchunk *c = chunkof(p, &i);
+  return c != NULL && BIT(c->used, i) && BIT(c->remembered, i);
+}
+
+void
+cell_clear_marks(bool youngonly) {
+  if (youngonly) {
+    for (size_t k = 0; k < _n.ndirty; ++k) {
+      memset(_n.dirty[k]->mark, 0, sizeof(_n.dirty[k]->mark));
+    }
+    return;
+  }
+  for (nchunk *c = _n.head; c != NULL; c = c->next) {
+    memset(c->mark, 0, sizeof(c->mark));
+  }
+}
+
+static void
+pinnedin(nchunk *c, bool youngonly, void (*fn)(void *, TYPE)) {
+  for (size_t w = 0; w < CELL_WORDS; ++w) {
+    uint64_t bits = (c->pinned[w] | c->removed[w]) & c->used[w];
+    if (youngonly) {
+      bits &= ~c->old[w];
+    }
+    while (bits != 0) {
+      size_t i = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      (*fn)((char *)c + i * CELL_SIZE, (TYPE)c->type[i]);
+    }
+  }
+}
+
+void
+cell_each_pinned(bool youngonly, void (*fn)(void *, TYPE)) {
+  if (youngonly) {
+    for (size_t k = 0; k < _n.ndirty; ++k) {
+      pinnedin(_n.dirty[k], true, fn);
+    }
+    return;
+  }
+  for (nchunk *c = _n.head; c != NULL; c = c->next) {
+    pinnedin(c, false, fn);
+  }
+}
+
+/* frees c's dead cells and promotes the rest; true if nothing's left */
+static bool
+sweepchunk(nchunk *c, bool minor, size_t *freed) {
+  bool empty = true;
+  for (size_t w = 0; w < CELL_WORDS; ++w) {
+    uint64_t live = c->mark[w] | c->pinned[w] | c->removed[w];
+    uint64_t keep = minor ? c->used[w] & (c->old[w] | live) : c->used[w] & live;
+    *freed += __builtin_popcountll(c->used[w] & ~keep);
+    c->used[w] = c->old[w] = keep;
+    c->remembered[w] = 0;
+    empty = empty && keep == 0;
+  }
+  c->dirty = false;
+  return empty;
+}
+
+/* whole bitmap words at a time, so a minor sweep costs next to
+nothing per chunk.  after either kind, every cell left is old and
+nothing is remembered, and the cursor starts over (from the first
+chunk, for a full sweep).  a full sweep also gives back chunks past NURSERY_KEEP that
+have nothing left in them */
+size_t
+cell_sweep(bool minor) {
+  size_t freed = 0, kept = 0;
+  if (minor) {
+    for (size_t k = 0; k < _n.ndirty; ++k) {
+      sweepchunk(_n.dirty[k], true, &freed);
+    }
+    /* the full old chunks before this are left for a full sweep */
+    _n.cur = _n.ndirty > 0 ? _n.dirty[0] : _n.cur;
+    _n.cell = FIRST_CELL;
+    _n.ndirty = 0;
+    return freed;
+  }
+  _n.ndirty = 0;
+  nchunk *prev = NULL, *c = _n.head;
+  while (c != NULL) {
+    nchunk *next = c->next;
+    bool empty = sweepchunk(c, false, &freed);
+    if (empty && ++kept > NURSERY_KEEP) {
+      if (prev != NULL) {
+        prev->next = next;
+      }
+      else {
+        _n.head = next;
+      }
+      if (_n.tail == c) {
+        _n.tail = prev;
+      }
+      --_n.nchunks;
+      free(c);
+    }
+    else {
+      prev = c;
+    }
+    c = next;
+  }
+  if (_n.setsize > 0) {
+    rehash(_n.setsize);
+  }
+  _n.cur = _n.head;
+  _n.cell = FIRST_CELL;
+  return freed;
+}
+
+void
+cell_counts(size_t *young, size_t *old) {
+  *young = *old = 0;
+  for (nchunk *c = _n.head; c != NULL; c = c->next) {
+    for (size_t w = 0; w < CELL_WORDS; ++w) {
+      *young += __builtin_popcountll(c->used[w] & ~c->old[w]);
+      *old += __builtin_popcountll(c->old[w]);
+    }
+  }
+}
+
+/* drops every chunk; for gc_init */
+void
+cell_reset(void) {
+  nchunk *c = _n.head;
+  while (c != NULL) {
+    nchunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(_n.set);
+  free(_n.dirty);
+  memset(&_n, 0, sizeof(_n));
+}
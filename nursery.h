@@ -0,0 +1,44 @@
+#ifndef NURSERY_H
+#define NURSERY_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "gc.h"
+
+/* the young generation for list nodes and envobjs, which are both
+CELL_SIZE bytes.  cells are handed out by a cursor that bumps through
+NURSERY_CHUNK-aligned chunks, skipping cells that are still in use,
+and each chunk keeps bitmaps of which cells are used, old (promoted),
+marked, pinned, removed and remembered.  nothing ever moves: promoting a cell
+just sets its old bit.
+
+this is gc.c's bookkeeping, and it does the locking; nothing here
+locks. */
+#define NURSERY_CHUNK 65536
+#define CELL_SIZE 16
+#define NURSERY_KEEP 16 /* empty chunks kept around after a full collect */
+
+void *cell_alloc(TYPE type);
+void cell_free(void *p);
+bool cell_live(void *p);  /* p is a cell that's in use */
+TYPE cell_type(void *p);
+bool cell_old(void *p);
+bool cell_mark(void *p);  /* true if p wasn't marked yet */
+void cell_pin(void *p, bool on);
+bool cell_pinned(void *p);
+/* p stays until cell_free, however it's pinned and unpinned */
+void cell_remove(void *p);
+bool cell_remember(void *p);  /* true if p wasn't remembered yet */
+bool cell_remembered(void *p);
+void cell_clear_marks(bool youngonly);
+/* fn(cell, type) on every pinned or removed cell, or just the young
+ones */
+void cell_each_pinned(bool youngonly, void (*fn)(void *, TYPE));
+/* frees the unmarked, unpinned, unremoved cells (only the young ones for a minor
+sweep, which only looks at chunks that have had cells handed out or
+remembered since the last sweep) and promotes the rest; returns how
+many were freed */
+size_t cell_sweep(bool minor);
+void cell_counts(size_t *young, size_t *old);
+void cell_reset(void);
+
+#endif
@@ -0,0 +1,815 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "simd.h"
+
+typedef void (*mapk_fn)(void *, const void *, size_t, const void *);
+typedef size_t (*select_fn)(void *, const void *, size_t, CMP, const void *);
+typedef size_t (*parity_fn)(void *, const void *, size_t, bool);
+typedef size_t (*between_fn)(void *, const void *, size_t, const void *, const void *);
+typedef void (*fold_fn)(const void *, size_t, void *);
+
+/* one entry per NUMTYPE */
+typedef struct kernels {
+  const char *name;
+  mapk_fn addk[4];
+  mapk_fn mulk[4];
+  select_fn select[4];
+  parity_fn parity[4];
+  between_fn between[4];
+  fold_fn sum[4];
+  fold_fn min[4];
+  fold_fn max[4];
+} kernels;
+
+/* the plain C loops.  integer arithmetic goes through the unsigned type
+(UT) so that overflow wraps instead of being undefined */
+#define SCALAR_KERNELS(T, UT, ACC, N)                                         \
+static inline bool                                                            \
+N##_cmp(T x, CMP op, T k) {                                                   \
+  switch (op) {                                                               \
+    case LT: return x < k;                                                    \
+    case LE: return x <= k;                                                   \
+    case GT: return x > k;                                                    \
+    case GE: return x >= k;                                                   \
+    case EQ: return x == k;                                                   \
+    default: return x != k;                                                   \
+  }                                                                           \
+}                                                                             \
+static void                                                                   \
+N##_addk(void *out, const void *in, size_t n, const void *k) {                \
+  T *o = out;                                                                 \
+  const T *x = in;                                                            \
+  UT c = (UT)*(const T *)k;                                                   \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    o[i] = (T)((UT)x[i] + c);                                                 \
+  }                                                                           \
+}                                                                             \
+static void                                                                   \
+N##_mulk(void *out, const void *in, size_t n, const void *k) {                \
+  T *o = out;                                                                 \
+  const T *x = in;                                                            \
+  UT c = (UT)*(const T *)k;                                                   \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    o[i] = (T)((UT)x[i] * c);                                                 \
+  }                                                                           \
+}                                                                             \
+static size_t                                                                 \
+N##_select(void *out, const void *in, size_t n, CMP op, const void *k) {      \
+  T *o = out;                                                                 \
+  const T *x = in;                                                            \
+  T c = *(const T *)k;                                                        \
+  size_t w = 0;                                                               \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    T v = x[i];                                                               \
+    if (N##_cmp(v, op, c)) {                                                  \
+      o[w++] = v;                                                             \
+    }                                                                         \
+  }                                                                           \
+  return w;                                                                   \
+}                                                                             \
+static size_t                                                                 \
+N##_between(void *out, const void *in, size_t n, const void *lo, const void *hi) { \
+  T *o = out;                                                                 \
+  const T *x = in;                                                            \
+  T l = *(const T *)lo;                                                       \
+  T h = *(const T *)hi;                                                       \
+  size_t w = 0;                                                               \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    T v = x[i];                                                               \
+    if (v >= l && v <= h) {                                                   \
+      o[w++] = v;                                                             \
+    }                                                                         \
+  }                                                                           \
+  return w;                                                                   \
+}                                                                             \
+static void                                                                   \
+N##_sum(const void *in, size_t n, void *out) {                                \
+  const T *x = in;                                                            \
+  ACC s = 0;                                                                  \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    s += x[i];                                                                \
+  }                                                                           \
+  *(ACC *)out = s;                                                            \
+}                                                                             \
+static void                                                                   \
+N##_min(const void *in, size_t n, void *out) {                                \
+  const T *x = in;                                                            \
+  T m = x[0];                                                                 \
+  for (size_t i = 1; i < n; ++i) {                                            \
+    m = x[i] < m ? x[i] : m;                                                  \
+  }                                                                           \
+  *(T *)out = m;                                                              \
+}                                                                             \
+static void                                                                   \
+N##_max(const void *in, size_t n, void *out) {                                \
+  const T *x = in;                                                            \
+  T m = x[0];                                                                 \
+  for (size_t i = 1; i < n; ++i) {                                            \
+    m = x[i] > m ? x[i] : m;                                                  \
+  }                                                                           \
+  *(T *)out = m;                                                              \
+}
+
+#define SCALAR_PARITY(T, N)                                                   \
+static size_t                                                                 \
+N##_parity(void *out, const void *in, size_t n, bool odd) {                   \
+  T *o = out;                                                                 \
+  const T *x = in;                                                            \
+  size_t w = 0;                                                               \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    T v = x[i];                                                               \
+    if ((bool)(v & 1) == odd) {                                               \
+      o[w++] = v;                                                             \
+    }                                                                         \
+  }                                                                           \
+  return w;                                                                   \
+}
+
+SCALAR_KERNELS(int32_t, uint32_t, int64_t, i32)
+SCALAR_KERNELS(int64_t, uint64_t, int64_t, i64)
+SCALAR_KERNELS(float, float, double, f32)
+SCALAR_KERNELS(double, double, double, f64)
+SCALAR_PARITY(int32_t, i32)
+SCALAR_PARITY(int64_t, i64)
+
+static const kernels scalar = {
+  "scalar",
+  { i32_addk, i64_addk, f32_addk, f64_addk },
+  { i32_mulk, i64_mulk, f32_mulk, f64_mulk },
+  { i32_select, i64_select, f32_select, f64_select },
+  { i32_parity, i64_parity, NULL, NULL },
+  { i32_between, i64_between, f32_between, f64_between },
+  { i32_sum, i64_sum, f32_sum, f64_sum },
+  { i32_min, i64_min, f32_min, f64_min },
+  { i32_max, i64_max, f32_max, f64_max }
+};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+/* AVX2.  each kernel does 256 bits at a time and hands the leftover
+tail to the scalar version.  filters compare a whole vector at once,
+then pack the passing lanes together with one permute from a table
+indexed by the comparison mask */
+#define AVX2 __attribute__((target("avx2")))
+
+static int32_t pack8[256][8];  /* 8 x 32 bit lanes */
+static int32_t pack4[16][8];   /* 4 x 64 bit lanes, as pairs of 32 bit indices */
+
+static void
+build_tables(void) {
+  for (int m = 0; m < 256; ++m) {
+    int w = 0;
+    for (int j = 0; j < 8; ++j) {
+      if (m & (1 << j)) {
+        pack8[m][w++] = j;
+      }
+    }
+    while (w < 8) {
+      pack8[m][w++] = 0;
+    }
+  }
+  for (int m = 0; m < 16; ++m) {
+    int w = 0;
+    for (int j = 0; j < 4; ++j) {
+      if (m & (1 << j)) {
+        pack4[m][w++] = 2 * j;
+        pack4[m][w++] = 2 * j + 1;
+      }
+    }
+    while (w < 8) {
+      pack4[m][w++] = 0;
+    }
+  }
+}
+
+/* stores the lanes of v picked by mask contiguously at o.  all 256 bits
+get written, but since o is never ahead of the input (w <= i and
+i + lanes <= n) that can't run off the end or clobber unread input */
+AVX2 static inline size_t
+pack32(void *o, __m256i v, int mask) {
+  __m256i idx = _mm256_loadu_si256((const __m256i *)pack8[mask]);
+  _mm256_storeu_si256((__m256i *)o, _mm256_permutevar8x32_epi32(v, idx));
+  return (size_t)__builtin_popcount(mask);
+}
+
+AVX2 static inline size_t
+pack64(void *o, __m256i v, int mask) {
+  __m256i idx = _mm256_loadu_si256((const __m256i *)pack4[mask]);
+  _mm256_storeu_si256((__m256i *)o, _mm256_permutevar8x32_epi32(v, idx));
+  return (size_t)__builtin_popcount(mask);
+}
+
+#define MASK32(m) _mm256_movemask_ps(_mm256_castsi256_ps(m))
+#define MASK64(m) _mm256_movemask_pd(_mm256_castsi256_pd(m))
+
+/* int32 */
+AVX2 static void
+i32_addk_avx2(void *out, const void *in, size_t n, const void *k) {
+  int32_t *o = out;
+  const int32_t *x = in;
+  __m256i c = _mm256_set1_epi32(*(const int32_t *)k);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    _mm256_storeu_si256((__m256i *)(o + i), _mm256_add_epi32(v, c));
+  }
+  i32_addk(o + i, x + i, n - i, k);
+}
+
+AVX2 static void
+i32_mulk_avx2(void *out, const void *in, size_t n, const void *k) {
+  int32_t *o = out;
+  const int32_t *x = in;
+  __m256i c = _mm256_set1_epi32(*(const int32_t *)k);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    _mm256_storeu_si256((__m256i *)(o + i), _mm256_mullo_epi32(v, c));
+  }
+  i32_mulk(o + i, x + i, n - i, k);
+}
+
+AVX2 static inline int
+i32_cmpmask(__m256i v, __m256i c, CMP op) {
+  switch (op) {
+    case LT: return MASK32(_mm256_cmpgt_epi32(c, v));
+    case LE: return ~MASK32(_mm256_cmpgt_epi32(v, c)) & 0xff;
+    case GT: return MASK32(_mm256_cmpgt_epi32(v, c));
+    case GE: return ~MASK32(_mm256_cmpgt_epi32(c, v)) & 0xff;
+    case EQ: return MASK32(_mm256_cmpeq_epi32(v, c));
+    default: return ~MASK32(_mm256_cmpeq_epi32(v, c)) & 0xff;
+  }
+}
+
+AVX2 static size_t
+i32_select_avx2(void *out, const void *in, size_t n, CMP op, const void *k) {
+  int32_t *o = out;
+  const int32_t *x = in;
+  __m256i c = _mm256_set1_epi32(*(const int32_t *)k);
+  size_t i = 0, w = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    w += pack32(o + w, v, i32_cmpmask(v, c, op));
+  }
+  return w + i32_select(o + w, x + i, n - i, op, k);
+}
+
+AVX2 static size_t
+i32_parity_avx2(void *out, const void *in, size_t n, bool odd) {
+  int32_t *o = out;
+  const int32_t *x = in;
+  __m256i one = _mm256_set1_epi32(1);
+  __m256i want = odd ? one : _mm256_setzero_si256();
+  size_t i = 0, w = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i m = _mm256_cmpeq_epi32(_mm256_and_si256(v, one), want);
+    w += pack32(o + w, v, MASK32(m));
+  }
+  return w + i32_parity(o + w, x + i, n - i, odd);
+}
+
+AVX2 static size_t
+i32_between_avx2(void *out, const void *in, size_t n, const void *lo, const void *hi) {
+  int32_t *o = out;
+  const int32_t *x = in;
+  __m256i l = _mm256_set1_epi32(*(const int32_t *)lo);
+  __m256i h = _mm256_set1_epi32(*(const int32_t *)hi);
+  size_t i = 0, w = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i out_of = _mm256_or_si256(_mm256_cmpgt_epi32(l, v), _mm256_cmpgt_epi32(v, h));
+    w += pack32(o + w, v, ~MASK32(out_of) & 0xff);
+  }
+  return w + i32_between(o + w, x + i, n - i, lo, hi);
+}
+
+AVX2 static void
+i32_sum_avx2(const void *in, size_t n, void *out) {
+  const int32_t *x = in;
+  __m256i acc = _mm256_setzero_si256();
+  int64_t lanes[4], tail;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  i32_sum(x + i, n - i, &tail);
+  *(int64_t *)out = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail;
+}
+
+AVX2 static void
+i32_min_avx2(const void *in, size_t n, void *out) {
+  const int32_t *x = in;
+  int32_t lanes[8];
+  size_t i = 8;
+  if (n < 16) {
+    i32_min(in, n, out);
+    return;
+  }
+  __m256i m = _mm256_loadu_si256((const __m256i *)x);
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i *)(x + i)));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, m);
+  i32_min(lanes, 8, out);
+  for (; i < n; ++i) {
+    *(int32_t *)out = x[i] < *(int32_t *)out ? x[i] : *(int32_t *)out;
+  }
+}
+
+AVX2 static void
+i32_max_avx2(const void *in, size_t n, void *out) {
+  const int32_t *x = in;
+  int32_t lanes[8];
+  size_t i = 8;
+  if (n < 16) {
+    i32_max(in, n, out);
+    return;
+  }
+  __m256i m = _mm256_loadu_si256((const __m256i *)x);
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i *)(x + i)));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, m);
+  i32_max(lanes, 8, out);
+  for (; i < n; ++i) {
+    *(int32_t *)out = x[i] > *(int32_t *)out ? x[i] : *(int32_t *)out;
+  }
+}
+
+/* int64; there's no 64 bit multiply in AVX2, so mulk stays scalar */
+AVX2 static void
+i64_addk_avx2(void *out, const void *in, size_t n, const void *k) {
+  int64_t *o = out;
+  const int64_t *x = in;
+  __m256i c = _mm256_set1_epi64x(*(const int64_t *)k);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    _mm256_storeu_si256((__m256i *)(o + i), _mm256_add_epi64(v, c));
+  }
+  i64_addk(o + i, x + i, n - i, k);
+}
+
+AVX2 static inline int
+i64_cmpmask(__m256i v, __m256i c, CMP op) {
+  switch (op) {
+    case LT: return MASK64(_mm256_cmpgt_epi64(c, v));
+    case LE: return ~MASK64(_mm256_cmpgt_epi64(v, c)) & 0xf;
+    case GT: return MASK64(_mm256_cmpgt_epi64(v, c));
+    case GE: return ~MASK64(_mm256_cmpgt_epi64(c, v)) & 0xf;
+    case EQ: return MASK64(_mm256_cmpeq_epi64(v, c));
+    default: return ~MASK64(_mm256_cmpeq_epi64(v, c)) & 0xf;
+  }
+}
+
+AVX2 static size_t
+i64_select_avx2(void *out, const void *in, size_t n, CMP op, const void *k) {
+  int64_t *o = out;
+  const int64_t *x = in;
+  __m256i c = _mm256_set1_epi64x(*(const int64_t *)k);
+  size_t i = 0, w = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    w += pack64(o + w, v, i64_cmpmask(v, c, op));
+  }
+  return w + i64_select(o + w, x + i, n - i, op, k);
+}
+
+AVX2 static size_t
+i64_parity_avx2(void *out, const void *in, size_t n, bool odd) {
+  int64_t *o = out;
+  const int64_t *x = in;
+  __m256i one = _mm256_set1_epi64x(1);
+  __m256i want = odd ? one : _mm256_setzero_si256();
+  size_t i = 0, w = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i m = _mm256_cmpeq_epi64(_mm256_and_si256(v, one), want);
+    w += pack64(o + w, v, MASK64(m));
+  }
+  return w + i64_parity(o + w, x + i, n - i, odd);
+}
+
+AVX2 static size_t
+i64_between_avx2(void *out, const void *in, size_t n, const void *lo, const void *hi) {
+  int64_t *o = out;
+  const int64_t *x = in;
+  __m256i l = _mm256_set1_epi64x(*(const int64_t *)lo);
+  __m256i h = _mm256_set1_epi64x(*(const int64_t *)hi);
+  size_t i = 0, w = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i out_of = _mm256_or_si256(_mm256_cmpgt_epi64(l, v), _mm256_cmpgt_epi64(v, h));
+    w += pack64(o + w, v, ~MASK64(out_of) & 0xf);
+  }
+  return w + i64_between(o + w, x + i, n - i, lo, hi);
+}
+
+AVX2 static void
+i64_sum_avx2(const void *in, size_t n, void *out) {
+  const int64_t *x = in;
+  __m256i acc = _mm256_setzero_si256();
+  int64_t lanes[4], tail;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(acc, _mm256_loadu_si256((const __m256i *)(x + i)));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  i64_sum(x + i, n - i, &tail);
+  *(int64_t *)out = (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] +
+    (uint64_t)lanes[2] + (uint64_t)lanes[3] + (uint64_t)tail);
+}
+
+AVX2 static void
+i64_min_avx2(const void *in, size_t n, void *out) {
+  const int64_t *x = in;
+  int64_t lanes[4];
+  size_t i = 4;
+  if (n < 8) {
+    i64_min(in, n, out);
+    return;
+  }
+  __m256i m = _mm256_loadu_si256((const __m256i *)x);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    m = _mm256_blendv_epi8(m, v, _mm256_cmpgt_epi64(m, v));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, m);
+  i64_min(lanes, 4, out);
+  for (; i < n; ++i) {
+    *(int64_t *)out = x[i] < *(int64_t *)out ? x[i] : *(int64_t *)out;
+  }
+}
+
+AVX2 static void
+i64_max_avx2(const void *in, size_t n, void *out) {
+  const int64_t *x = in;
+  int64_t lanes[4];
+  size_t i = 4;
+  if (n < 8) {
+    i64_max(in, n, out);
+    return;
+  }
+  __m256i m = _mm256_loadu_si256((const __m256i *)x);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    m = _mm256_blendv_epi8(m, v, _mm256_cmpgt_epi64(v, m));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, m);
+  i64_max(lanes, 4, out);
+  for (; i < n; ++i) {
+    *(int64_t *)out = x[i] > *(int64_t *)out ? x[i] : *(int64_t *)out;
+  }
+}
+
+/* float.  the ordered predicates are false for NaN and NEQ_UQ is
+true for it, which is what the scalar comparisons do */
+AVX2 static void
+f32_addk_avx2(void *out, const void *in, size_t n, const void *k) {
+  float *o = out;
+  const float *x = in;
+  __m256 c = _mm256_set1_ps(*(const float *)k);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(o + i, _mm256_add_ps(_mm256_loadu_ps(x + i), c));
+  }
+  f32_addk(o + i, x + i, n - i, k);
+}
+
+AVX2 static void
+f32_mulk_avx2(void *out, const void *in, size_t n, const void *k) {
+  float *o = out;
+  const float *x = in;
+  __m256 c = _mm256_set1_ps(*(const float *)k);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(o + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), c));
+  }
+  f32_mulk(o + i, x + i, n - i, k);
+}
+
+AVX2 static inline int
+f32_cmpmask(__m256 v, __m256 c, CMP op) {
+  switch (op) {
+    case LT: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_LT_OQ));
+    case LE: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_LE_OQ));
+    case GT: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_GT_OQ));
+    case GE: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_GE_OQ));
+    case EQ: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_EQ_OQ));
+    default: return _mm256_movemask_ps(_mm256_cmp_ps(v, c, _CMP_NEQ_UQ));
+  }
+}
+
+AVX2 static size_t
+f32_select_avx2(void *out, const void *in, size_t n, CMP op, const void *k) {
+  float *o = out;
+  const float *x = in;
+  __m256 c = _mm256_set1_ps(*(const float *)k);
+  size_t i = 0, w = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    w += pack32(o + w, _mm256_castps_si256(v), f32_cmpmask(v, c, op));
+  }
+  return w + f32_select(o + w, x + i, n - i, op, k);
+}
+
+AVX2 static size_t
+f32_between_avx2(void *out, const void *in, size_t n, const void *lo, const void *hi) {
+  float *o = out;
+  const float *x = in;
+  __m256 l = _mm256_set1_ps(*(const float *)lo);
+  __m256 h = _mm256_set1_ps(*(const float *)hi);
+  size_t i = 0, w = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256 in_range = _mm256_and_ps(_mm256_cmp_ps(v, l, _CMP_GE_OQ), _mm256_cmp_ps(v, h, _CMP_LE_OQ));
+    w += pack32(o + w, _mm256_castps_si256(v), _mm256_movemask_ps(in_range));
+  }
+  return w + f32_between(o + w, x + i, n - i, lo, hi);
+}
+
+/* the vector sums add in a different order than the scalar loop, so
+float results can differ from it in the last bits */
+AVX2 static void
+f32_sum_avx2(const void *in, size_t n, void *out) {
+  const float *x = in;
+  __m256d acc = _mm256_setzero_pd();
+  double lanes[4], tail;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+  }
+  _mm256_storeu_pd(lanes, acc);
+  f32_sum(x + i, n - i, &tail);
+  *(double *)out = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail;
+}
+
+/* min_ps(v, m) returns m when v is NaN, like the scalar loop does.
+every lane starts from x[0] so a NaN elsewhere can't get stuck in one */
+AVX2 static void
+f32_min_avx2(const void *in, size_t n, void *out) {
+  const float *x = in;
+  float lanes[8];
+  size_t i = 0;
+  if (n < 16) {
+    f32_min(in, n, out);
+    return;
+  }
+  __m256 m = _mm256_set1_ps(x[0]);
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_min_ps(_mm256_loadu_ps(x + i), m);
+  }
+  _mm256_storeu_ps(lanes, m);
+  f32_min(lanes, 8, out);
+  for (; i < n; ++i) {
+    *(float *)out = x[i] < *(float *)out ? x[i] : *(float *)out;
+  }
+}
+
+AVX2 static void
+f32_max_avx2(const void *in, size_t n, void *out) {
+  const float *x = in;
+  float lanes[8];
+  size_t i = 0;
+  if (n < 16) {
+    f32_max(in, n, out);
+    return;
+  }
+  __m256 m = _mm256_set1_ps(x[0]);
+  for (; i + 8 <= n; i += 8) {
+    m = _mm256_max_ps(_mm256_loadu_ps(x + i), m);
+  }
+  _mm256_storeu_ps(lanes, m);
+  f32_max(lanes, 8, out);
+  for (; i < n; ++i) {
+    *(float *)out = x[i] > *(float *)out ? x[i] : *(float *)out;
+  }
+}
+
+/* double */
+AVX2 static void
+f64_addk_avx2(void *out, const void *in, size_t n, const void *k) {
+  double *o = out;
+  const double *x = in;
+  __m256d c = _mm256_set1_pd(*(const double *)k);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(o + i, _mm256_add_pd(_mm256_loadu_pd(x + i), c));
+  }
+  f64_addk(o + i, x + i, n - i, k);
+}
+
+AVX2 static void
+f64_mulk_avx2(void *out, const void *in, size_t n, const void *k) {
+  double *o = out;
+  const double *x = in;
+  __m256d c = _mm256_set1_pd(*(const double *)k);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(o + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), c));
+  }
+  f64_mulk(o + i, x + i, n - i, k);
+}
+
+AVX2 static inline int
+f64_cmpmask(__m256d v, __m256d c, CMP op) {
+  switch (op) {
+    case LT: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_LT_OQ));
+    case LE: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_LE_OQ));
+    case GT: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_GT_OQ));
+    case GE: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_GE_OQ));
+    case EQ: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_EQ_OQ));
+    default: return _mm256_movemask_pd(_mm256_cmp_pd(v, c, _CMP_NEQ_UQ));
+  }
+}
+
+AVX2 static size_t
+f64_select_avx2(void *out, const void *in, size_t n, CMP op, const void *k) {
+  double *o = out;
+  const double *x = in;
+  __m256d c = _mm256_set1_pd(*(const double *)k);
+  size_t i = 0, w = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    w += pack64(o + w, _mm256_castpd_si256(v), f64_cmpmask(v, c, op));
+  }
+  return w + f64_select(o + w, x + i, n - i, op, k);
+}
+
+AVX2 static size_t
+f64_between_avx2(void *out, const void *in, size_t n, const void *lo, const void *hi) {
+  double *o = out;
+  const double *x = in;
+  __m256d l = _mm256_set1_pd(*(const double *)lo);
+  __m256d h = _mm256_set1_pd(*(const double *)hi);
+  size_t i = 0, w = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(x + i);
+    __m256d in_range = _mm256_and_pd(_mm256_cmp_pd(v, l, _CMP_GE_OQ), _mm256_cmp_pd(v, h, _CMP_LE_OQ));
+    w += pack64(o + w, _mm256_castpd_si256(v), _mm256_movemask_pd(in_range));
+  }
+  return w + f64_between(o + w, x + i, n - i, lo, hi);
+}
+
+AVX2 static void
+f64_sum_avx2(const void *in, size_t n, void *out) {
+  const double *x = in;
+  __m256d acc = _mm256_setzero_pd();
+  double lanes[4], tail;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_pd(acc, _mm256_loadu_pd(x + i));
+  }
+  _mm256_storeu_pd(lanes, acc);
+  f64_sum(x + i, n - i, &tail);
+  *(double *)out = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail;
+}
+
+AVX2 static void
+f64_min_avx2(const void *in, size_t n, void *out) {
+  const double *x = in;
+  double lanes[4];
+  size_t i = 0;
+  if (n < 8) {
+    f64_min(in, n, out);
+    return;
+  }
+  __m256d m = _mm256_set1_pd(x[0]);
+  for (; i + 4 <= n; i += 4) {
+    m = _mm256_min_pd(_mm256_loadu_pd(x + i), m);
+  }
+  _mm256_storeu_pd(lanes, m);
+  f64_min(lanes, 4, out);
+  for (; i < n; ++i) {
+    *(double *)out = x[i] < *(double *)out ? x[i] : *(double *)out;
+  }
+}
+
+AVX2 static void
+f64_max_avx2(const void *in, size_t n, void *out) {
+  const double *x = in;
+  double lanes[4];
+  size_t i = 0;
+  if (n < 8) {
+    f64_max(in, n, out);
+    return;
+  }
+  __m256d m = _mm256_set1_pd(x[0]);
+  for (; i + 4 <= n; i += 4) {
+    m = _mm256_max_pd(_mm256_loadu_pd(x + i), m);
+  }
+  _mm256_storeu_pd(lanes, m);
+  f64_max(lanes, 4, out);
+  for (; i < n; ++i) {
+    *(double *)out = x[i] > *(double *)out ? x[i] : *(double *)out;
+  }
+}
+
+static const kernels avx2 = {
+  "avx2",
+  { i32_addk_avx2, i64_addk_avx2, f32_addk_avx2, f64_addk_avx2 },
+  { i32_mulk_avx2, i64_mulk, f32_mulk_avx2, f64_mulk_avx2 },
+  { i32_select_avx2, i64_select_avx2, f32_select_avx2, f64_select_avx2 },
+  { i32_parity_avx2, i64_parity_avx2, NULL, NULL },
+  { i32_between_avx2, i64_between_avx2, f32_between_avx2, f64_between_avx2 },
+  { i32_sum_avx2, i64_sum_avx2, f32_sum_avx2, f64_sum_avx2 },
+  { i32_min_avx2, i64_min_avx2, f32_min_avx2, f64_min_avx2 },
+  { i32_max_avx2, i64_max_avx2, f32_max_avx2, f64_max_avx2 }
+};
+#endif
+
+/* dispatch: picked once, the first time any kernel is called */
+static const kernels *best = &scalar;
+static const kernels *impl = NULL;
+static pthread_once_t picked = PTHREAD_ONCE_INIT;
+
+static void
+pick(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    build_tables();
+    best = &avx2;
+  }
+#endif
+  if (impl == NULL) {
+    impl = best;
+  }
+}
+
+static const kernels *
+use(void) {
+  pthread_once(&picked, pick);
+  return impl;
+}
+
+/* public functions */
+void
+num_addk(NUMTYPE t, void *out, const void *in, size_t n, const void *k) {
+  use()->addk[t](out, in, n, k);
+}
+
+void
+num_mulk(NUMTYPE t, void *out, const void *in, size_t n, const void *k) {
+  use()->mulk[t](out, in, n, k);
+}
+
+size_t
+num_select(NUMTYPE t, void *out, const void *in, size_t n, CMP op, const void *k) {
+  return use()->select[t](out, in, n, op, k);
+}
+
+size_t
+num_parity(NUMTYPE t, void *out, const void *in, size_t n, bool odd) {
+  parity_fn fn = use()->parity[t];
+  if (fn == NULL) {
+    exit(1);
+  }
+  return fn(out, in, n, odd);
+}
+
+size_t
+num_between(NUMTYPE t, void *out, const void *in, size_t n, const void *lo, const void *hi) {
+  return use()->between[t](out, in, n, lo, hi);
+}
+
+void
+num_sum(NUMTYPE t, const void *in, size_t n, void *out) {
+  use()->sum[t](in, n, out);
+}
+
+void
+num_min(NUMTYPE t, const void *in, size_t n, void *out) {
+  use()->min[t](in, n, out);
+}
+
+void
+num_max(NUMTYPE t, const void *in, size_t n, void *out) {
+  use()->max[t](in, n, out);
+}
+
+size_t
+num_size(NUMTYPE t) {
+  static const size_t sizes[] = { sizeof(int32_t), sizeof(int64_t), sizeof(float), sizeof(double) };
+  return sizes[t];
+}
+
+const char *
+simd_impl(void) {
+  return use()->name;
+}
+
+void
+simd_scalar(bool on) {
+  pthread_once(&picked, pick);
+  impl = on ? &scalar : best;
+}
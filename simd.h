@@ -0,0 +1,48 @@
+#ifndef SIMD_H
+#define SIMD_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* typed numeric kernels over flat buffers.  on x86 the AVX2 versions
+are picked at runtime when the cpu has it; everything else (and every
+op AVX2 can't do in one instruction, like 64 bit multiply) runs the
+plain C loops. */
+typedef enum NUMTYPE {
+  I32,
+  I64,
+  F32,
+  F64
+} NUMTYPE;
+
+typedef enum CMP {
+  LT,
+  LE,
+  GT,
+  GE,
+  EQ,
+  NE
+} CMP;
+
+/* out[i] = in[i] + *k and out[i] = in[i] * *k; out may be in.
+k points at a value of the buffer's type */
+void num_addk(NUMTYPE t, void *out, const void *in, size_t n, const void *k);
+void num_mulk(NUMTYPE t, void *out, const void *in, size_t n, const void *k);
+
+/* filters: the elements that pass are packed into out, in order, and
+their count is returned.  out needs room for n elements; it may be in */
+size_t num_select(NUMTYPE t, void *out, const void *in, size_t n, CMP op, const void *k);
+size_t num_parity(NUMTYPE t, void *out, const void *in, size_t n, bool odd); /* I32 and I64 only */
+size_t num_between(NUMTYPE t, void *out, const void *in, size_t n, const void *lo, const void *hi);
+
+/* folds.  sums go into an int64_t for the integer types and a double
+for the float ones; min and max go into the buffer's own type.
+n must be > 0 for min and max */
+void num_sum(NUMTYPE t, const void *in, size_t n, void *out);
+void num_min(NUMTYPE t, const void *in, size_t n, void *out);
+void num_max(NUMTYPE t, const void *in, size_t n, void *out);
+
+size_t num_size(NUMTYPE t);
+const char *simd_impl(void);  /* "avx2" or "scalar" */
+void simd_scalar(bool on);    /* force the plain C loops, e.g. to compare */
+
+#endif
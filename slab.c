@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "slab.h"
+
+struct slab_ {
+  slabpool *pool;
+  slab *prev;     /* slabs are kept on a doubly linked list in their pool */
+  slab *next;
+  void *free;     /* cells that have been handed back */
+  char *bump;     /* next never-used cell */
+  char *end;
+  size_t live;    /* cells currently handed out */
+  int isfull;
+  uint32_t *tags; /* a word per cell for slab_tag, made on first use */
+};
+
+/* cells start after the header, 16 byte aligned */
+#define SLAB_HEADER ((sizeof(slab) + 15) & ~(size_t)15)
+
+static slabpool *pools = NULL;
+
+/* every slab, hashed on its address, so slab_tag can tell a cell from
+any other pointer */
+static slab **slabset = NULL;
+static size_t setsize = 0;
+static size_t nslabs = 0;
+
+/* the pools are only locked while other threads might be using them,
+and always on a thread that's asked to (slab_lock_always) */
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int parallel = 0;
+static _Thread_local bool always = false;
+
+/* private functions */
+static bool
+slab_lock(void) {
+  if (!always && atomic_load(&parallel) == 0) {
+    return false;
+  }
+  pthread_mutex_lock(&slab_mutex);
+  return true;
+}
+
+static void
+slab_unlock(bool locked) {
+  if (locked) {
+    pthread_mutex_unlock(&slab_mutex);
+  }
+}
+static void
+unlink_slab(slab **list, slab *s) {
+  if (s->prev != NULL) {
+    s->prev->next = s->next;
+  }
+  else {
+    *list = s->next;
+  }
+  if (s->next != NULL) {
+    s->next->prev = s->prev;
+  }
+  s->prev = s->next = NULL;
+}
+
+static void
+push_slab(slab **list, slab *s) {
+  s->prev = NULL;
+  s->next = *list;
+  if (*list != NULL) {
+    (*list)->prev = s;
+  }
+  *list = s;
+}
+
+static size_t
+slabhash(slab *s) {
+  uint64_t h = (uint64_t)(uintptr_t)s / SLAB_SIZE;
+  return (size_t)(h * 0x9e3779b97f4a7c15ull >> 17);
+}
+
+static void
+setput(slab **set, size_t size, slab *s) {
+  size_t i = slabhash(s) & (size - 1);
+  while (set[i] != NULL) {
+    i = (i + 1) & (size - 1);
+  }
+  set[i] = s;
+}
+
+static void
+rehash(size_t size) {
+  slab **set = calloc(size, sizeof(slab *));
+  if (set == NULL) {
+    exit(1);
+  }
+  for (slabpool *p = pools; p != NULL; p = p->next) {
+    for (slab *s = p->partial; s != NULL; s = s->next) {
+      setput(set, size, s);
+    }
+    for (slab *s = p->full; s != NULL; s = s->next) {
+      setput(set, size, s);
+    }
+  }
+  free(slabset);
+  slabset = set;
+  setsize = size;
+}
+
+static slab *
+newslab(slabpool *p) {
+  slab *s = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+  if (s == NULL) {
+    exit(1);
+  }
+  if (p->partial == NULL && p->full == NULL) {
+    p->next = pools;
+    pools = p;
+  }
+  s->pool = p;
+  s->prev = s->next = NULL;
+  s->free = NULL;
+  s->bump = (char *)s + SLAB_HEADER;
+  s->end = (char *)s + SLAB_SIZE;
+  s->live = 0;
+  s->isfull = 0;
+  s->tags = NULL;
+  /* it isn't on a list yet, so rehash can't see it; put it in after */
+  ++nslabs;
+  if (2 * nslabs > setsize) {
+    rehash(setsize ? setsize * 2 : 64);
+  }
+  setput(slabset, setsize, s);
+  return s;
+}
+
+/* public functions */
+void *
+slab_alloc(slabpool *p) {
+  bool locked = slab_lock();
+  slab *s = p->partial;
+  void *o;
+  if (s == NULL) {
+    s = newslab(p);
+    push_slab(&p->partial, s);
+  }
+  if (s->free != NULL) {
+    o = s->free;
+    s->free = *(void **)o;
+  }
+  else {
+    o = s->bump;
+    s->bump += p->size;
+  }
+  s->live++;
+  if (s->free == NULL && s->bump + p->size > s->end) {
+    unlink_slab(&p->partial, s);
+    push_slab(&p->full, s);
+    s->isfull = 1;
+  }
+  slab_unlock(locked);
+  return o;
+}
+
+void
+slab_free(void *obj) {
+  slab *s = (slab *)((uintptr_t)obj & ~(uintptr_t)(SLAB_SIZE - 1));
+  bool locked = slab_lock();
+  *(void **)obj = s->free;
+  s->free = obj;
+  s->live--;
+  if (s->isfull) {
+    unlink_slab(&s->pool->full, s);
+    push_slab(&s->pool->partial, s);
+    s->isfull = 0;
+  }
+  slab_unlock(locked);
+}
+
+/* hands completely empty slabs back to the system in one go,
+keeping one per pool around so the next allocation doesn't thrash */
+void
+slab_trim(void) {
+  bool locked = slab_lock();
+  bool trimmed = false;
+  slabpool *p;
+  for (p = pools; p != NULL; p = p->next) {
+    slab *s = p->partial;
+    int kept = 0;
+    while (s != NULL) {
+      slab *next = s->next;
+      if (s->live == 0) {
+        if (kept) {
+          unlink_slab(&p->partial, s);
+          free(s->tags);
+          free(s);
+          --nslabs;
+          trimmed = true;
+        }
+        kept = 1;
+      }
+      s = next;
+    }
+  }
+  if (trimmed) {
+    rehash(setsize);
+  }
+  slab_unlock(locked);
+}
+
+/* a word of metadata for obj, kept beside its slab, or NULL if obj
+isn't a cell some pool has handed out.  slab doesn't use it; it's for
+whoever owns the cell (the gc keeps obj's ref position there).  it's
+0 for a cell that's never had one set, and it isn't cleared when the
+cell is freed and handed out again */
+uint32_t *
+slab_tag(void *obj) {
+  uintptr_t a = (uintptr_t)obj;
+  uint32_t *tag = NULL;
+  bool locked = slab_lock();
+  if (setsize == 0) {
+    slab_unlock(locked);
+    return NULL;
+  }
+  slab *s = (slab *)(a & ~(uintptr_t)(SLAB_SIZE - 1));
+  size_t i = slabhash(s) & (setsize - 1);
+  while (slabset[i] != NULL && slabset[i] != s) {
+    i = (i + 1) & (setsize - 1);
+  }
+  char *first = (char *)s + SLAB_HEADER;
+  if (slabset[i] != NULL && slabset[i] == s && (char *)obj >= first && (char *)obj < s->bump
+      && ((char *)obj - first) % s->pool->size == 0) {
+    if (s->tags == NULL) {
+      s->tags = calloc((SLAB_SIZE - SLAB_HEADER) / s->pool->size, sizeof(uint32_t));
+      if (s->tags == NULL) {
+        exit(1);
+      }
+    }
+    tag = &s->tags[((char *)obj - first) / s->pool->size];
+  }
+  slab_unlock(locked);
+  return tag;
+}
+
+/* nest these around anything that allocates from more than one thread */
+/* the calling thread takes the lock from now on, whatever parallel
+says; the gc's sweeper does this */
+void
+slab_lock_always(void) {
+  always = true;
+}
+
+void
+slab_enter_parallel(void) {
+  atomic_fetch_add(&parallel, 1);
+}
+
+void
+slab_leave_parallel(void) {
+  atomic_fetch_sub(&parallel, 1);
+}
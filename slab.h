@@ -0,0 +1,31 @@
+#ifndef SLAB_H
+#define SLAB_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* fixed-size object pools carved out of SLAB_SIZE pages.
+each slab sits at a SLAB_SIZE-aligned address, so any object can
+find its slab (and its pool) by masking its own address */
+#define SLAB_SIZE 16384
+#define SLAB_ALIGN 8 /* object sizes are rounded up to a multiple of this */
+
+typedef struct slab_ slab;
+
+typedef struct slabpool {
+  size_t size;            /* object size after rounding to the size class */
+  slab *partial;          /* slabs with at least one free cell */
+  slab *full;             /* slabs with none */
+  struct slabpool *next;  /* every pool that has allocated, for slab_trim */
+} slabpool;
+
+#define SLABPOOL_INIT(sz) { (((sz) + SLAB_ALIGN - 1) / SLAB_ALIGN) * SLAB_ALIGN, NULL, NULL, NULL }
+
+void *slab_alloc(slabpool *p);
+void slab_free(void *obj);
+void slab_trim(void);
+uint32_t *slab_tag(void *obj);
+void slab_lock_always(void);
+void slab_enter_parallel(void);
+void slab_leave_parallel(void);
+
+#endif
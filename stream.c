@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "list.h"
+#include "closure.h"
+#include "stream.h"
+#include "gc.h"
+
+/* private functions */
+static stream *
+newstream(void) {
+  stream *s = gc_malloc(sizeof(stream), STREAM);
+  s->l = NULL;
+  s->start = s->end = 0;
+  s->step = 1;
+  s->nstages = 0;
+  return s;
+}
+
+/* for the gc: the source list and every stage's closure and args (args
+that aren't gc'd are skipped like any other unknown pointer) */
+void
+stream_trace(void *_s, void (*visit)(void *)) {
+  stream *s = _s;
+  visit(s->l);
+  for (size_t k = 0; k < s->nstages; ++k) {
+    visit(s->stages[k].cl);
+    visit(s->stages[k].args);
+  }
+}
+
+static stage *
+addstage(stream *s, STAGE kind) {
+  if (s->nstages == STREAM_STAGES) {
+    exit(1);
+  }
+  stage *st = &s->stages[s->nstages++];
+  gc_barrier(s); /* the stage may bring a closure or args along */
+  st->kind = kind;
+  st->map = NULL;
+  st->filter = NULL;
+  st->cl = NULL;
+  st->args = NULL;
+  st->n = 0;
+  return st;
+}
+
+/* runs one element through every stage and hands it to sink.
+ints from a range source point at a scratch int on the stack, so they
+are only good until sink returns (scollect boxes the ones it keeps);
+an slmap stage gets them lifted into a stack envobj, good for the
+call and no longer.
+take and takewhile stop the whole run: once nothing more can get past
+them, there's no point producing anything upstream. */
+static void
+run(stream *s, void (*sink)(void *, void *, void *), void *sinkargs) {
+  list *curr = s->l;
+  long i = s->start;
+  int scratch;
+  envobj lifted = { &scratch, sizeof(int) };
+  size_t seen[STREAM_STAGES] = {0};
+  bool done = false;
+  for (size_t k = 0; k < s->nstages; ++k) {
+    if (s->stages[k].kind == STAKE && s->stages[k].n == 0) {
+      return;
+    }
+  }
+  while (!done) {
+    void *v;
+    if (s->source == FROMLIST) {
+      if (curr == NULL) {
+        return;
+      }
+      v = curr->val;
+      curr = curr->next;
+    }
+    else {
+      if (s->source == FROMRANGE && (s->step > 0 ? i > s->end : i < s->end)) {
+        return;
+      }
+      scratch = (int)i;
+      i += s->step;
+      v = &scratch;
+    }
+    size_t k;
+    for (k = 0; k < s->nstages; ++k) {
+      stage *st = &s->stages[k];
+      if (st->kind == SMAP) {
+        v = (*st->map)(v, st->args);
+      }
+      else if (st->kind == SFILTER) {
+        if (!(*st->filter)(v, st->args)) {
+          break;
+        }
+      }
+      else if (st->kind == SLMAP) {
+        v = call(st->cl, v == &scratch ? &lifted : (envobj *)v);
+      }
+      else if (st->kind == STAKE) {
+        if (++seen[k] == st->n) {
+          done = true; /* this one still goes through */
+        }
+      }
+      else if (st->kind == SDROP) {
+        if (seen[k] < st->n) {
+          seen[k]++;
+          break;
+        }
+      }
+      else if (!(*st->filter)(v, st->args)) { /* takewhile */
+        return;
+      }
+    }
+    if (k == s->nstages) {
+      (*sink)(v, &scratch, sinkargs);
+    }
+  }
+}
+
+typedef struct itercall {
+  void (*fn)(void *, void *);
+  void *args;
+} itercall;
+
+static void
+itersink(void *v, void *scratch, void *args) {
+  itercall *ic = args;
+  (*ic->fn)(v, ic->args);
+}
+
+typedef struct foldcall {
+  void *(*fn)(void *, void *, void *);
+  void *acc;
+  void *args;
+} foldcall;
+
+static void
+foldsink(void *v, void *scratch, void *args) {
+  foldcall *fc = args;
+  fc->acc = (*fc->fn)(fc->acc, v, fc->args);
+}
+
+static void
+collectsink(void *v, void *scratch, void *args) {
+  if (v == scratch) {
+    v = boxint(*(int *)scratch);
+  }
+  builder_append((listbuilder *)args, v);
+}
+
+/* public functions */
+stream *
+from_list(list *l) {
+  stream *s = newstream();
+  s->source = FROMLIST;
+  s->l = l;
+  return s;
+}
+
+/* inclusive, like range */
+stream *
+from_range(int start, int end) {
+  stream *s = newstream();
+  s->source = FROMRANGE;
+  s->start = start;
+  s->end = end;
+  return s;
+}
+
+/* start, start + step, ... up to and including end if it's hit.
+step can be negative, but not 0 */
+stream *
+from_range_step(int start, int end, int step) {
+  stream *s = from_range(start, end);
+  if (step == 0) {
+    exit(1);
+  }
+  s->step = step;
+  return s;
+}
+
+stream *
+from_count(int start, int step) {
+  stream *s = newstream();
+  s->source = FROMCOUNT;
+  s->start = start;
+  s->step = step;
+  return s;
+}
+
+stream *
+smap(stream *s, void *(*fn)(void *, void *), void *args) {
+  stage *st = addstage(s, SMAP);
+  st->map = fn;
+  st->args = args;
+  return s;
+}
+
+stream *
+sfilter(stream *s, bool (*fn)(void *, void *), void *args) {
+  stage *st = addstage(s, SFILTER);
+  st->filter = fn;
+  st->args = args;
+  return s;
+}
+
+stream *
+slmap(stream *s, closure *cl) {
+  stage *st = addstage(s, SLMAP);
+  st->cl = cl;
+  return s;
+}
+
+/* only the first n elements to reach this stage get past it */
+stream *
+stake(stream *s, size_t n) {
+  stage *st = addstage(s, STAKE);
+  st->n = n;
+  return s;
+}
+
+/* the first n elements to reach this stage are dropped */
+stream *
+sdrop(stream *s, size_t n) {
+  stage *st = addstage(s, SDROP);
+  st->n = n;
+  return s;
+}
+
+/* ends the stream at the first element fn rejects */
+stream *
+stakewhile(stream *s, bool (*fn)(void *, void *), void *args) {
+  stage *st = addstage(s, STAKEWHILE);
+  st->filter = fn;
+  st->args = args;
+  return s;
+}
+
+void
+siter(stream *s, void (*fn)(void *, void *), void *args) {
+  itercall ic;
+  ic.fn = fn;
+  ic.args = args;
+  run(s, itersink, &ic);
+}
+
+/* the only place a stream builds a list */
+list *
+scollect(stream *s) {
+  listbuilder b;
+  builder_init(&b);
+  run(s, collectsink, &b);
+  return builder_list(&b);
+}
+
+/* acc = fn(acc, x, args) for every element; returns the final acc */
+void *
+sfold(stream *s, void *(*fn)(void *, void *, void *), void *acc, void *args) {
+  foldcall fc;
+  fc.fn = fn;
+  fc.acc = acc;
+  fc.args = args;
+  run(s, foldsink, &fc);
+  return fc.acc;
+}
@@ -0,0 +1,64 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include <stdbool.h>
+#include "list.h"
+#include "closure.h"
+
+/* a lazy pipeline: a source plus a chain of stages that is only run
+when a terminal (siter, scollect, sfold) asks for it.  every element goes
+through the whole chain before the next one is produced, so no
+intermediate lists get built. */
+#define STREAM_STAGES 16
+
+typedef enum STAGE {
+  SMAP,
+  SFILTER,
+  SLMAP,
+  STAKE,
+  SDROP,
+  STAKEWHILE
+} STAGE;
+
+typedef struct stage {
+  STAGE kind;
+  void *(*map)(void *, void *);
+  bool (*filter)(void *, void *); /* also the predicate for takewhile */
+  closure *cl;
+  void *args;
+  size_t n; /* for take and drop */
+} stage;
+
+typedef struct stream {
+  enum { FROMLIST, FROMRANGE, FROMCOUNT } source;
+  list *l;
+  long start;
+  long end;
+  long step;
+  size_t nstages;
+  stage stages[STREAM_STAGES];
+} stream;
+
+stream *from_list(list *l);
+stream *from_range(int start, int end);
+stream *from_range_step(int start, int end, int step);
+stream *from_count(int start, int step); /* never ends; use take or takewhile */
+
+/* stages are added to s in place and s is returned, so they chain */
+stream *smap(stream *s, void *(*fn)(void *, void *), void *args);
+stream *sfilter(stream *s, bool (*fn)(void *, void *), void *args);
+/* call(cl, x) on each element x, which has to be an envobj (liftlist's
+lists are); ints from a range or count are lifted for the call on the
+stack, so cl mustn't hold on to its argument */
+stream *slmap(stream *s, closure *cl);
+stream *stake(stream *s, size_t n);
+stream *sdrop(stream *s, size_t n);
+stream *stakewhile(stream *s, bool (*fn)(void *, void *), void *args);
+
+void stream_trace(void *, void (*)(void *));
+
+/* terminals */
+void siter(stream *s, void (*fn)(void *, void *), void *args);
+list *scollect(stream *s);
+void *sfold(stream *s, void *(*fn)(void *, void *, void *), void *acc, void *args);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TAGGED_H
+#define TAGGED_H
+#include <stdint.h>
+
+/* small ints stored right in a void * instead of behind one.
+real pointers from malloc (and the slabs) are always at least 2 byte
+aligned, so a set low bit can't be an object: it's an int shifted left
+by one.  nothing tagged is ever registered with the gc. */
+#define TAGINT(i) ((void *)(((uintptr_t)(intptr_t)(i) << 1) | 1))
+#define UNTAGINT(p) ((int)((intptr_t)(p) >> 1))
+#define ISTAGGED(p) (((uintptr_t)(p) & 1) != 0)
+
+/* reads an int whether it's tagged or a boxed int * */
+static inline int
+intval(void *p) {
+  return ISTAGGED(p) ? UNTAGINT(p) : *(int *)p;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef TEST_H
+#define TEST_H
+#include <stdio.h>
+#include <stdlib.h>
+
+/* prints the failed condition and where it was, and keeps going */
+static int failures = 0;
+
+#define CHECK(cond) do {                                                      \
+  if (!(cond)) {                                                              \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);           \
+    failures++;                                                               \
+  }                                                                           \
+} while (0)
+
+/* what main returns */
+#define DONE(name) (printf("%s: %s\n", (name), failures ? "FAIL" : "ok"), failures != 0)
+
+#endif
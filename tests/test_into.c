@@ -0,0 +1,48 @@
+#include "list.h"
+#include "functional.h"
+#include "closure.h"
+#include "memo.h"
+#include "trampoline.h"
+#include "gc.h"
+#include "test.h"
+
+/* a closure with only an into body has to work everywhere a closure
+does, not just with call_into */
+
+static void
+addinto(list *env, void *out, size_t size) {
+  *(int *)out = *(int *)unbox(env) + *(int *)unbox(env->next);
+}
+
+int
+main(int argc, char **argv) {
+  gc_init();
+  closure *addthree = bind_into(NULL, addinto, sizeof(int), liftint(3));
+
+  CHECK(*(int *)call(addthree, liftint(4)) == 7);
+
+  int r = 0;
+  call_into(addthree, liftint(5), &r, sizeof(int));
+  CHECK(r == 8);
+
+  int i = 0;
+  for (list *l = lmap(liftlist(range(0, 9), sizeof(int)), addthree); l != NULL; l = l->next, ++i) {
+    CHECK(*(int *)l->val == i + 3);
+  }
+  CHECK(i == 10);
+
+  callframe f;
+  frame_init(&f, addthree);
+  CHECK(*(int *)frame_call(&f, liftint(10)) == 13);
+  frame_free(&f);
+
+  closure *m = memoize(addthree);
+  CHECK(*(int *)call(m, liftint(1)) == 4);
+  CHECK(*(int *)call(m, liftint(1)) == 4);
+  memo_free(m);
+
+  CHECK(*(int *)trampoline(addthree, liftint(20)) == 23);
+
+  gc_collect();
+  return DONE("test_into");
+}
@@ -0,0 +1,107 @@
+#include "list.h"
+#include "functional.h"
+#include "ulist.h"
+#include "stream.h"
+#include "vector.h"
+#include "closure.h"
+#include "gc.h"
+#include "test.h"
+
+/* containers that are rooted must keep everything they hold alive
+through a collect.  boxed ints come from a slab, so once a collect has
+freed them, the boxes that come after reuse the cells and the values
+we check would change */
+#define N 1000
+
+static void *
+add(list *env) {
+  return boxint(*(int *)unbox(env) + *(int *)unbox(env->next));
+}
+
+/* new garbage over whatever the collect freed */
+static void
+churn(void) {
+  for (int i = 0; i < 4 * N; ++i) {
+    boxint(-1);
+  }
+  range(0, N);
+}
+
+static void
+collect(void) {
+  gc_collect();
+  churn();
+  gc_collect_minor();
+  churn();
+  gc_collect();
+}
+
+int
+main(int argc, char **argv) {
+  gc_init();
+
+  /* a ulist a few chunks long: every chunk after the first, and the
+  values in all of them */
+  ulist u = newulist();
+  gc_root(&u.head);
+  for (int i = 0; i < N; ++i) {
+    u = uappend(u, boxint(i));
+  }
+  collect();
+  int i = 0;
+  for (chunk *c = u.head; c != NULL; c = c->next) {
+    for (size_t k = 0; k < c->count; ++k, ++i) {
+      CHECK(*(int *)c->vals[k] == i);
+    }
+  }
+  CHECK(i == N);
+
+  /* a stream: its source list, and the closure of an slmap stage */
+  stream *s = from_list(liftlist(range(0, N - 1), sizeof(int)));
+  s = slmap(s, bind(NULL, add, liftint(1)));
+  gc_root(&s);
+  collect();
+  i = 0;
+  for (list *l = s->l; l != NULL; l = l->next, ++i) {
+    CHECK(*(int *)unbox(l) == i);
+  }
+  CHECK(i == N);
+  list *out = scollect(s);
+  i = 1;
+  for (list *l = out; l != NULL; l = l->next, ++i) {
+    CHECK(*(int *)l->val == i);
+  }
+  CHECK(i == N + 1);
+
+  /* a vector of pointers: the things they point at */
+  vector *v = vector_fromlist(range(0, N - 1));
+  gc_root(&v);
+  collect();
+  for (size_t k = 0; k < v->length; ++k) {
+    CHECK(**(int **)vat(v, k) == (int)k);
+  }
+  CHECK(v->length == N);
+
+  /* a plain vector of ints is a leaf: pushing onto one mustn't put it
+  on the remembered set, where a minor collect would go looking for a
+  tracer it hasn't got */
+  vector *w = newvector(sizeof(int), 0);
+  gc_mark(w);
+  for (int k = 0; k < N; ++k) {
+    vpush(w, &k);
+  }
+  gc_collect_minor();
+  for (size_t k = 0; k < w->length; ++k) {
+    CHECK(*(int *)vat(w, k) == (int)k);
+  }
+  CHECK(w->length == N);
+  gc_unmark(w);
+
+  /* and once they're unrooted, they go */
+  gc_unroot(&u.head);
+  gc_unroot(&s);
+  gc_unroot(&v);
+  gc_collect();
+
+  return DONE("test_trace");
+}
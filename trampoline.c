@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "list.h"
+#include "closure.h"
+#include "trampoline.h"
+
+/* what a body returns to say "call this next" */
+static char tailcall_marker;
+#define TAILCALL ((void *)&tailcall_marker)
+
+/* per thread: the pending tail call, the closure that's running and two
+banks of tcarg slots.  the bank the current step's args came from is
+left alone while the body fills the other one, then they swap */
+typedef struct tcstate {
+  closure *next;
+  envobj *args[2];
+  int nargs;
+  closure *current;
+  envobj bank[2][2];
+  int fill;
+} tcstate;
+
+static __thread tcstate tc;
+
+void *
+tailcall(closure *c, envobj *arg) {
+  tc.next = c;
+  tc.args[0] = arg;
+  tc.nargs = 1;
+  return TAILCALL;
+}
+
+void *
+tailcall2(closure *c, envobj *a, envobj *b) {
+  tc.next = c;
+  tc.args[0] = a;
+  tc.args[1] = b;
+  tc.nargs = 2;
+  return TAILCALL;
+}
+
+envobj *
+tcarg(int i, void *val, ssize_t size) {
+  envobj *e = &tc.bank[tc.fill][i & 1];
+  e->val = val;
+  e->size = size;
+  return e;
+}
+
+closure *
+current_closure(void) {
+  return tc.current;
+}
+
+/* links c's env followed by the args into nodes, growing it if needed */
+static list *
+buildenv(list **nodes, size_t *capacity, closure *c, envobj **args, int nargs) {
+  size_t n = nargs;
+  list *curr;
+  for (curr = c->env; curr != NULL; curr = curr->next) {
+    ++n;
+  }
+  if (n > *capacity) {
+    free(*nodes);
+    *capacity = n * 2;
+    *nodes = malloc(*capacity * sizeof(list));
+    if (*nodes == NULL) {
+      exit(1);
+    }
+  }
+  list *o = *nodes;
+  size_t i = 0;
+  for (curr = c->env; curr != NULL; curr = curr->next, ++i) {
+    o[i].val = curr->val;
+    o[i].next = &o[i + 1];
+  }
+  for (int k = 0; k < nargs; ++k, ++i) {
+    o[i].val = (void *)args[k];
+    o[i].next = &o[i + 1];
+  }
+  o[n - 1].next = NULL;
+  return o;
+}
+
+/* runs c on nargs args, following any tail calls the bodies return */
+static void *
+run(closure *c, envobj *a, envobj *b, int nargs) {
+  tcstate saved = tc;  /* a body may run a trampoline of its own */
+  list *nodes = NULL;
+  size_t capacity = 0;
+  envobj *args[2] = { a, b };
+  void *result;
+
+  tc.fill ^= 1;  /* the caller may have made a and b with tcarg */
+  for (;;) {
+    list *env = buildenv(&nodes, &capacity, c, args, nargs);
+    tc.current = c;
+    result = apply(c, env);
+    if (result != TAILCALL) {
+      break;
+    }
+    c = tc.next;
+    args[0] = tc.args[0];
+    args[1] = tc.args[1];
+    nargs = tc.nargs;
+    tc.fill ^= 1;
+  }
+  free(nodes);
+  tc = saved;
+  return result;
+}
+
+/* call(c, arg) and call2(c, a, b), with tail calls */
+void *
+trampoline(closure *c, envobj *arg) {
+  return run(c, arg, NULL, 1);
+}
+
+void *
+trampoline2(closure *c, envobj *a, envobj *b) {
+  return run(c, a, b, 2);
+}
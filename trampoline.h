@@ -0,0 +1,25 @@
+#ifndef TRAMPOLINE_H
+#define TRAMPOLINE_H
+#include <unistd.h>
+#include "list.h"
+#include "closure.h"
+
+/* tail calls for closures.  a body run under trampoline() can return
+tailcall(next, arg) (or tailcall2) instead of calling next itself; the
+trampoline then calls next in a loop, so recursion that's all tail
+calls runs in constant stack.  the env a body sees is built in one
+buffer that's reused for every step, so like lmap_fast the body must
+not keep the list it's given.
+
+tcarg(i, val, size) gives a lifted argument that lives in the
+trampoline and is good for the next step, so a loop doesn't have to
+allocate an envobj per step: i is 0 or 1, for the first or second
+argument of the tail call. */
+void *trampoline(closure *c, envobj *arg);
+void *trampoline2(closure *c, envobj *a, envobj *b);
+void *tailcall(closure *c, envobj *arg);
+void *tailcall2(closure *c, envobj *a, envobj *b);
+envobj *tcarg(int i, void *val, ssize_t size);
+closure *current_closure(void);  /* the closure whose body is running */
+
+#endif
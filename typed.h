@@ -0,0 +1,121 @@
+#ifndef TYPED_H
+#define TYPED_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* type specialised versions of the functional functions, stamped out
+by macro.  elements are stored by value in a flat array (a T##vec), and
+callbacks take and return T with no args pointer.  everything is static
+inline, so when the callback is itself a static inline function the
+compiler can inline it into the loop and vectorize the lot.
+
+  DEFINE_FUNCTIONAL(T, N) makes Nvec, Nvec_new, Nvec_push, Nvec_free,
+    iter_N, map_N, filter_N and fold_N
+  DEFINE_RANGE(T, N) adds range_N for numeric T
+
+vecs aren't registered with the gc; free them with Nvec_free. */
+
+#define DEFINE_FUNCTIONAL(T, N)                                               \
+typedef struct N##vec {                                                       \
+  T *data;                                                                    \
+  size_t length;                                                              \
+  size_t capacity;                                                            \
+} N##vec;                                                                     \
+                                                                              \
+static inline N##vec                                                          \
+N##vec_new(size_t capacity) {                                                 \
+  N##vec v;                                                                   \
+  v.capacity = capacity > 0 ? capacity : 8;                                   \
+  v.data = malloc(v.capacity * sizeof(T));                                    \
+  if (v.data == NULL) {                                                       \
+    exit(1);                                                                  \
+  }                                                                           \
+  v.length = 0;                                                               \
+  return v;                                                                   \
+}                                                                             \
+                                                                              \
+static inline void                                                            \
+N##vec_push(N##vec *v, T x) {                                                 \
+  if (v->length == v->capacity) {                                             \
+    T *data = realloc(v->data, 2 * v->capacity * sizeof(T));                  \
+    if (data == NULL) {                                                       \
+      exit(1);                                                                \
+    }                                                                         \
+    v->data = data;                                                           \
+    v->capacity *= 2;                                                         \
+  }                                                                           \
+  v->data[v->length++] = x;                                                   \
+}                                                                             \
+                                                                              \
+static inline void                                                            \
+N##vec_free(N##vec *v) {                                                      \
+  free(v->data);                                                              \
+  v->data = NULL;                                                             \
+  v->length = v->capacity = 0;                                                \
+}                                                                             \
+                                                                              \
+static inline void                                                            \
+iter_##N(const N##vec *v, void (*fn)(T)) {                                    \
+  for (size_t i = 0; i < v->length; ++i) {                                    \
+    fn(v->data[i]);                                                           \
+  }                                                                           \
+}                                                                             \
+                                                                              \
+static inline N##vec                                                          \
+map_##N(const N##vec *v, T (*fn)(T)) {                                        \
+  N##vec o = N##vec_new(v->length);                                           \
+  T *in = v->data;                                                            \
+  T *out = o.data;                                                            \
+  for (size_t i = 0; i < v->length; ++i) {                                    \
+    out[i] = fn(in[i]);                                                       \
+  }                                                                           \
+  o.length = v->length;                                                       \
+  return o;                                                                   \
+}                                                                             \
+                                                                              \
+static inline N##vec                                                          \
+filter_##N(const N##vec *v, bool (*fn)(T)) {                                  \
+  N##vec o = N##vec_new(v->length);                                           \
+  T *in = v->data;                                                            \
+  T *out = o.data;                                                            \
+  size_t w = 0;                                                               \
+  for (size_t i = 0; i < v->length; ++i) {                                    \
+    T x = in[i];                                                              \
+    out[w] = x;                                                               \
+    w += fn(x) ? 1 : 0;                                                       \
+  }                                                                           \
+  o.length = w;                                                               \
+  return o;                                                                   \
+}                                                                             \
+                                                                              \
+static inline T                                                               \
+fold_##N(const N##vec *v, T (*fn)(T, T), T acc) {                             \
+  for (size_t i = 0; i < v->length; ++i) {                                    \
+    acc = fn(acc, v->data[i]);                                                \
+  }                                                                           \
+  return acc;                                                                 \
+}
+
+/* inclusive, like range; step 1 */
+#define DEFINE_RANGE(T, N)                                                    \
+static inline N##vec                                                          \
+range_##N(T start, T end) {                                                   \
+  size_t n = end >= start ? (size_t)(end - start) + 1 : 0;                    \
+  N##vec v = N##vec_new(n);                                                   \
+  for (size_t i = 0; i < n; ++i) {                                            \
+    v.data[i] = start + (T)i;                                                 \
+  }                                                                           \
+  v.length = n;                                                               \
+  return v;                                                                   \
+}
+
+DEFINE_FUNCTIONAL(int, int)
+DEFINE_FUNCTIONAL(long, long)
+DEFINE_FUNCTIONAL(double, double)
+DEFINE_FUNCTIONAL(void *, ptr)
+DEFINE_RANGE(int, int)
+DEFINE_RANGE(long, long)
+DEFINE_RANGE(double, double)
+
+#endif
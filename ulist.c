@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "list.h"
+#include "ulist.h"
+#include "gc.h"
+
+/* chunks are gc objects of their own type, so a collect follows them
+on to the next chunk and the values they hold */
+static chunk *
+newchunk(void) {
+  chunk *c = gc_malloc(sizeof(chunk), UCHUNK);
+  c->count = 0;
+  c->next = NULL;
+  return c;
+}
+
+ulist
+newulist(void) {
+  ulist l;
+  l.head = l.last = NULL;
+  l.length = 0;
+  return l;
+}
+
+ulist
+uappend(ulist l, void *v) {
+  if (l.last == NULL) {
+    l.head = l.last = newchunk();
+  }
+  else if (l.last->count == ULIST_CHUNK) {
+    chunk *c = newchunk();
+    l.last->next = c;
+    l.last = c;
+  }
+  l.last->vals[l.last->count++] = v;
+  l.length++;
+  gc_barrier(l.last);
+  return l;
+}
+
+/* chunks in the middle of a concatenated list may be partly full;
+everything here goes by count, so that's fine */
+ulist
+uconcat(ulist h, ulist t) {
+  if (h.head == NULL) {
+    return t;
+  }
+  if (t.head == NULL) {
+    return h;
+  }
+  h.last->next = t.head;
+  gc_barrier(h.last);
+  h.last = t.last;
+  h.length += t.length;
+  return h;
+}
+
+/* shallow copy; the copy is packed into full chunks */
+ulist
+ucopy(ulist l) {
+  ulist o = newulist();
+  chunk *c;
+  for (c = l.head; c != NULL; c = c->next) {
+    for (size_t i = 0; i < c->count; ++i) {
+      o = uappend(o, c->vals[i]);
+    }
+  }
+  return o;
+}
+
+void *
+ulast(ulist l) {
+  return l.last->vals[l.last->count - 1];
+}
+
+/* drops the last element; an emptied chunk is unlinked and left to the gc */
+ulist
+uinit(ulist l) {
+  l.length--;
+  if (--l.last->count > 0 || l.last == l.head) {
+    return l;
+  }
+  chunk *c;
+  for (c = l.head; c->next != l.last; c = c->next)
+    ;
+  c->next = NULL;
+  l.last = c;
+  return l;
+}
+
+void
+uiter(ulist l, void (*fn)(void *, void *), void *args) {
+  chunk *c;
+  for (c = l.head; c != NULL; c = c->next) {
+    for (size_t i = 0; i < c->count; ++i) {
+      (*fn)(c->vals[i], args);
+    }
+  }
+}
+
+ulist
+umap(ulist l, void *(*fn)(void *, void *), void *args) {
+  ulist o = newulist();
+  chunk *c;
+  for (c = l.head; c != NULL; c = c->next) {
+    for (size_t i = 0; i < c->count; ++i) {
+      o = uappend(o, (*fn)(c->vals[i], args));
+    }
+  }
+  return o;
+}
+
+ulist
+ufilter(ulist l, bool (*fn)(void *, void *), void *args) {
+  ulist o = newulist();
+  chunk *c;
+  for (c = l.head; c != NULL; c = c->next) {
+    for (size_t i = 0; i < c->count; ++i) {
+      if ((*fn)(c->vals[i], args)) {
+        o = uappend(o, c->vals[i]);
+      }
+    }
+  }
+  return o;
+}
+
+/* for the gc: a chunk points at the next one and at its values.  root
+a ulist by its head: gc_root(&u.head) */
+void
+uchunk_trace(void *_c, void (*visit)(void *)) {
+  chunk *c = _c;
+  visit(c->next);
+  for (size_t i = 0; i < c->count; ++i) {
+    visit(c->vals[i]);
+  }
+}
+
+/* conversions to and from the pointer-per-element list */
+ulist
+ulist_fromlist(list *l) {
+  ulist o = newulist();
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    o = uappend(o, curr->val);
+  }
+  return o;
+}
+
+list *
+ulist_tolist(ulist l) {
+  listbuilder b;
+  chunk *c;
+  builder_init(&b);
+  for (c = l.head; c != NULL; c = c->next) {
+    for (size_t i = 0; i < c->count; ++i) {
+      builder_append(&b, c->vals[i]);
+    }
+  }
+  return builder_list(&b);
+}
@@ -0,0 +1,40 @@
+#ifndef ULIST_H
+#define ULIST_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+
+/* an unrolled list: same idea as list, but every node (a chunk) holds
+up to ULIST_CHUNK values, so walking it touches one cache line per
+handful of elements instead of one per element */
+#define ULIST_CHUNK 32
+
+typedef struct chunk_ {
+  size_t count;
+  struct chunk_ *next;
+  void *vals[ULIST_CHUNK];
+} chunk;
+
+typedef struct ulist {
+  chunk *head;
+  chunk *last;
+  size_t length;
+} ulist;
+
+ulist newulist(void);
+ulist uappend(ulist l, void *v);
+ulist uconcat(ulist h, ulist t);
+ulist ucopy(ulist l);
+void *ulast(ulist l);
+ulist uinit(ulist l);
+
+void uiter(ulist l, void (*fn)(void *, void *), void *args);
+ulist umap(ulist l, void *(*fn)(void *, void *), void *args);
+ulist ufilter(ulist l, bool (*fn)(void *, void *), void *args);
+
+void uchunk_trace(void *, void (*)(void *));
+
+ulist ulist_fromlist(list *l);
+list *ulist_tolist(ulist l);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "list.h"
+#include "vector.h"
+#include "gc.h"
+
+vector *
+newvector(size_t elsize, size_t capacity) {
+  vector *v = gc_malloc(sizeof(vector), VECTOR);
+  if (capacity == 0) {
+    capacity = 8;
+  }
+  v->data = malloc(elsize * capacity);
+  if (v->data == NULL) {
+    exit(1);
+  }
+  v->elsize = elsize;
+  v->length = 0;
+  v->capacity = capacity;
+  return v;
+}
+
+/* copies elsize bytes from el onto the end; data may move */
+vector *
+vpush(vector *v, const void *el) {
+  if (v->length == v->capacity) {
+    void *data = realloc(v->data, v->elsize * v->capacity * 2);
+    if (data == NULL) {
+      exit(1);
+    }
+    v->data = data;
+    v->capacity *= 2;
+  }
+  memcpy(vat(v, v->length), el, v->elsize);
+  v->length++;
+  gc_barrier(v); /* a PVECTOR needs it; for any other vector it does nothing */
+  return v;
+}
+
+void
+vector_free(void *_v) {
+  vector *v = _v;
+  free(v->data);
+  free(v);
+}
+
+/* for the gc: a PVECTOR's elements are pointers */
+void
+pvector_trace(void *_v, void (*visit)(void *)) {
+  vector *v = _v;
+  for (size_t i = 0; i < v->length; ++i) {
+    visit(*(void **)vat(v, i));
+  }
+}
+
+/* the functional bits: each one is a single pass over the buffer */
+void
+viter(vector *v, void (*fn)(void *, void *), void *args) {
+  char *p = v->data;
+  char *end = p + v->length * v->elsize;
+  for (; p < end; p += v->elsize) {
+    (*fn)(p, args);
+  }
+}
+
+/* fn(out, in, args) writes one outsize byte result into out */
+vector *
+vmap(vector *v, size_t outsize, void (*fn)(void *, void *, void *), void *args) {
+  vector *o = newvector(outsize, v->length);
+  char *in = v->data;
+  char *out = o->data;
+  for (size_t i = 0; i < v->length; ++i) {
+    (*fn)(out, in, args);
+    in += v->elsize;
+    out += outsize;
+  }
+  o->length = v->length;
+  return o;
+}
+
+vector *
+vfilter(vector *v, bool (*fn)(void *, void *), void *args) {
+  vector *o = newvector(v->elsize, v->length);
+  char *in = v->data;
+  char *out = o->data;
+  for (size_t i = 0; i < v->length; ++i, in += v->elsize) {
+    if ((*fn)(in, args)) {
+      memcpy(out, in, v->elsize);
+      out += v->elsize;
+      o->length++;
+    }
+  }
+  return o;
+}
+
+/* fn(acc, el, args) folds el into acc in place; returns acc */
+void *
+vfold(vector *v, void *acc, void (*fn)(void *, void *, void *), void *args) {
+  char *p = v->data;
+  char *end = p + v->length * v->elsize;
+  for (; p < end; p += v->elsize) {
+    (*fn)(acc, p, args);
+  }
+  return acc;
+}
+
+/* inclusive, like range, but the ints are stored flat */
+vector *
+vrange(int start, int end) {
+  size_t n = end >= start ? (size_t)end - start + 1 : 0;
+  vector *v = newvector(sizeof(int), n);
+  int *d = v->data;
+  for (size_t i = 0; i < n; ++i) {
+    d[i] = start + (int)i;
+  }
+  v->length = n;
+  return v;
+}
+
+/* conversions.  fromlist copies the list's pointers, not what they
+point at; tolist makes nodes that point into the vector's buffer
+(so they're only good while the vector is alive and unpushed) */
+vector *
+vector_fromlist(list *l) {
+  vector *v = newvector(sizeof(void *), 0);
+  gc_register(v, PVECTOR); /* it holds pointers now, so the gc follows them */
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    vpush(v, &curr->val);
+  }
+  return v;
+}
+
+/* copies elsize bytes from behind each element into the vector */
+vector *
+vector_unboxlist(list *l, size_t elsize) {
+  vector *v = newvector(elsize, 0);
+  list *curr;
+  for (curr = l; curr != NULL; curr = curr->next) {
+    vpush(v, curr->val);
+  }
+  return v;
+}
+
+list *
+vector_tolist(vector *v) {
+  listbuilder b;
+  builder_init(&b);
+  for (size_t i = 0; i < v->length; ++i) {
+    builder_append(&b, vat(v, i));
+  }
+  return builder_list(&b);
+}
@@ -0,0 +1,33 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+
+/* a growable flat array; elements are elsize bytes each and live
+by value in data.  the vector (header and buffer) is one gc object. */
+typedef struct vector {
+  void *data;
+  size_t elsize;
+  size_t length;
+  size_t capacity;
+} vector;
+
+#define vat(v, i) ((void *)((char *)(v)->data + (i) * (v)->elsize)) /* O(1) indexing */
+
+vector *newvector(size_t elsize, size_t capacity);
+vector *vpush(vector *v, const void *el);
+void vector_free(void *);
+void pvector_trace(void *, void (*)(void *));
+
+void viter(vector *v, void (*fn)(void *, void *), void *args);
+vector *vmap(vector *v, size_t outsize, void (*fn)(void *, void *, void *), void *args);
+vector *vfilter(vector *v, bool (*fn)(void *, void *), void *args);
+void *vfold(vector *v, void *acc, void (*fn)(void *, void *, void *), void *args);
+vector *vrange(int start, int end);
+
+vector *vector_fromlist(list *l);
+vector *vector_unboxlist(list *l, size_t elsize);
+list *vector_tolist(vector *v);
+
+#endif
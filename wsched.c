@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "closure.h"
+#include "wsched.h"
+#include "gc.h"
+
+#define SPIN_ROUNDS 64 /* failed steal rounds before a worker goes to sleep */
+#define MAX_SPLITS 64
+
+typedef struct deque {
+  pthread_mutex_t lock;
+  task **buf;
+  size_t cap;    /* always a power of two */
+  atomic_size_t top;    /* thieves take from here */
+  atomic_size_t bottom; /* the owner pushes and pops here; both only change under lock */
+} deque;
+
+typedef struct worker {
+  deque q;
+  pthread_t thread;
+  unsigned seed;
+  atomic_ulong tasks;
+  atomic_ulong steals;
+  atomic_ulong idle;
+} worker;
+
+typedef struct scheduler {
+  worker *workers;
+  int n;            /* workers, counting worker 0 (the thread that called sched_init) */
+  deque inject;     /* tasks spawned by threads that aren't workers */
+  atomic_long queued;
+  atomic_int sleepers;
+  pthread_mutex_t sleeplock;
+  pthread_cond_t wake;
+  atomic_bool quit;
+} scheduler;
+
+/* this IS the scheduler */
+static scheduler _sched = { NULL, 0 };
+static _Thread_local int self = -1;
+
+/* private functions */
+static void
+deque_init(deque *q) {
+  pthread_mutex_init(&q->lock, NULL);
+  q->cap = 64;
+  q->buf = malloc(q->cap * sizeof(task *));
+  if (q->buf == NULL) {
+    exit(1);
+  }
+  atomic_init(&q->top, 0);
+  atomic_init(&q->bottom, 0);
+}
+
+static void
+deque_destroy(deque *q) {
+  pthread_mutex_destroy(&q->lock);
+  free(q->buf);
+}
+
+static void
+push_bottom(deque *q, task *t) {
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom - q->top == q->cap) {
+    task **buf = malloc(2 * q->cap * sizeof(task *));
+    if (buf == NULL) {
+      exit(1);
+    }
+    for (size_t i = q->top; i < q->bottom; ++i) {
+      buf[i & (2 * q->cap - 1)] = q->buf[i & (q->cap - 1)];
+    }
+    free(q->buf);
+    q->buf = buf;
+    q->cap *= 2;
+  }
+  q->buf[q->bottom & (q->cap - 1)] = t;
+  q->bottom++;
+  pthread_mutex_unlock(&q->lock);
+}
+
+static task *
+pop_bottom(deque *q) {
+  task *t = NULL;
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom > q->top) {
+    q->bottom--;
+    t = q->buf[q->bottom & (q->cap - 1)];
+  }
+  pthread_mutex_unlock(&q->lock);
+  return t;
+}
+
+static task *
+steal_top(deque *q) {
+  task *t = NULL;
+  /* unlocked peek so empty deques cost nothing; the locked check decides */
+  if (atomic_load_explicit(&q->bottom, memory_order_relaxed) ==
+      atomic_load_explicit(&q->top, memory_order_relaxed)) {
+    return NULL;
+  }
+  pthread_mutex_lock(&q->lock);
+  if (q->bottom > q->top) {
+    t = q->buf[q->top & (q->cap - 1)];
+    q->top++;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return t;
+}
+
+static void
+push(task *t) {
+  gc_enter_parallel(); /* left again when t finishes */
+  push_bottom(self >= 0 ? &_sched.workers[self].q : &_sched.inject, t);
+  atomic_fetch_add(&_sched.queued, 1);
+  if (atomic_load(&_sched.sleepers) > 0) {
+    pthread_mutex_lock(&_sched.sleeplock);
+    pthread_cond_broadcast(&_sched.wake);
+    pthread_mutex_unlock(&_sched.sleeplock);
+  }
+}
+
+/* own deque first (newest task, it's hot in cache), then tasks from
+outside, then the oldest task of a randomly chosen victim */
+static task *
+find_work(void) {
+  task *t = NULL;
+  if (self >= 0) {
+    t = pop_bottom(&_sched.workers[self].q);
+  }
+  if (t == NULL) {
+    t = steal_top(&_sched.inject);
+  }
+  if (t == NULL) {
+    unsigned seed = self >= 0 ? _sched.workers[self].seed : (unsigned)(size_t)&t;
+    int start = (int)(rand_r(&seed) % _sched.n);
+    if (self >= 0) {
+      _sched.workers[self].seed = seed;
+    }
+    for (int i = 0; i < _sched.n && t == NULL; ++i) {
+      int victim = (start + i) % _sched.n;
+      if (victim != self) {
+        t = steal_top(&_sched.workers[victim].q);
+      }
+    }
+    if (t != NULL && self >= 0) {
+      atomic_fetch_add(&_sched.workers[self].steals, 1);
+    }
+  }
+  if (t != NULL) {
+    atomic_fetch_sub(&_sched.queued, 1);
+  }
+  return t;
+}
+
+static void
+execute(task *t) {
+  (*t->run)(t);
+  if (self >= 0) {
+    atomic_fetch_add(&_sched.workers[self].tasks, 1);
+  }
+  gc_leave_parallel();
+  if (t->detached) {
+    free(t);
+  }
+  else {
+    atomic_store(&t->done, 1);
+  }
+}
+
+static void *
+workerloop(void *arg) {
+  int spins = 0;
+  self = (int)(size_t)arg;
+  while (!atomic_load(&_sched.quit)) {
+    task *t = find_work();
+    if (t != NULL) {
+      execute(t);
+      spins = 0;
+      continue;
+    }
+    if (++spins < SPIN_ROUNDS) {
+      sched_yield();
+      continue;
+    }
+    spins = 0;
+    atomic_fetch_add(&_sched.workers[self].idle, 1);
+    pthread_mutex_lock(&_sched.sleeplock);
+    atomic_fetch_add(&_sched.sleepers, 1);
+    while (atomic_load(&_sched.queued) == 0 && !atomic_load(&_sched.quit)) {
+      pthread_cond_wait(&_sched.wake, &_sched.sleeplock);
+    }
+    atomic_fetch_sub(&_sched.sleepers, 1);
+    pthread_mutex_unlock(&_sched.sleeplock);
+  }
+  return NULL;
+}
+
+static task *
+newtask(void (*run)(task *)) {
+  task *t = malloc(sizeof(task));
+  if (t == NULL) {
+    exit(1);
+  }
+  t->run = run;
+  t->fn = NULL;
+  t->ctx = NULL;
+  t->lo = t->hi = 0;
+  t->cl = NULL;
+  t->arg = NULL;
+  t->result = NULL;
+  t->detached = false;
+  atomic_init(&t->done, 0);
+  return t;
+}
+
+static void
+runclosure(task *t) {
+  t->result = call(t->cl, t->arg);
+}
+
+static void
+runfn(task *t) {
+  (*t->fn)(t->ctx);
+}
+
+/* public functions */
+void
+sched_init(int nworkers) {
+  sched_shutdown();
+  if (nworkers <= 0) {
+    nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (nworkers <= 0) {
+    nworkers = 1;
+  }
+  _sched.n = nworkers;
+  _sched.workers = calloc(nworkers, sizeof(worker));
+  if (_sched.workers == NULL) {
+    exit(1);
+  }
+  deque_init(&_sched.inject);
+  atomic_init(&_sched.queued, 0);
+  atomic_init(&_sched.sleepers, 0);
+  atomic_init(&_sched.quit, false);
+  pthread_mutex_init(&_sched.sleeplock, NULL);
+  pthread_cond_init(&_sched.wake, NULL);
+  for (int i = 0; i < nworkers; ++i) {
+    deque_init(&_sched.workers[i].q);
+    _sched.workers[i].seed = (unsigned)i * 2654435761u + 1;
+  }
+  self = 0;
+  for (int i = 1; i < nworkers; ++i) {
+    if (pthread_create(&_sched.workers[i].thread, NULL, workerloop, (void *)(size_t)i) != 0) {
+      exit(1);
+    }
+  }
+}
+
+int
+sched_size(void) {
+  return _sched.n;
+}
+
+/* outstanding tasks are dropped, so sync everything first */
+void
+sched_shutdown(void) {
+  if (_sched.n == 0) {
+    return;
+  }
+  pthread_mutex_lock(&_sched.sleeplock);
+  atomic_store(&_sched.quit, true);
+  pthread_cond_broadcast(&_sched.wake);
+  pthread_mutex_unlock(&_sched.sleeplock);
+  for (int i = 1; i < _sched.n; ++i) {
+    pthread_join(_sched.workers[i].thread, NULL);
+  }
+  for (int i = 0; i < _sched.n; ++i) {
+    deque_destroy(&_sched.workers[i].q);
+  }
+  deque_destroy(&_sched.inject);
+  pthread_mutex_destroy(&_sched.sleeplock);
+  pthread_cond_destroy(&_sched.wake);
+  free(_sched.workers);
+  _sched.workers = NULL;
+  _sched.n = 0;
+  self = -1;
+}
+
+task *
+sched_spawn(closure *cl, envobj *arg) {
+  if (_sched.n == 0) {
+    sched_init(0);
+  }
+  task *t = newtask(runclosure);
+  t->cl = cl;
+  t->arg = arg;
+  push(t);
+  return t;
+}
+
+task *
+sched_spawn_fn(void (*fn)(void *), void *ctx) {
+  if (_sched.n == 0) {
+    sched_init(0);
+  }
+  task *t = newtask(runfn);
+  t->fn = fn;
+  t->ctx = ctx;
+  push(t);
+  return t;
+}
+
+void
+sched_post(void (*fn)(void *), void *ctx) {
+  if (_sched.n == 0) {
+    sched_init(0);
+  }
+  task *t = newtask(runfn);
+  t->fn = fn;
+  t->ctx = ctx;
+  t->detached = true;
+  push(t);
+}
+
+bool
+sched_help(void) {
+  if (_sched.n == 0) {
+    return false;
+  }
+  task *t = find_work();
+  if (t == NULL) {
+    return false;
+  }
+  execute(t);
+  return true;
+}
+
+void *
+sched_sync(task *t) {
+  while (!atomic_load(&t->done)) {
+    task *other = find_work();
+    if (other != NULL) {
+      execute(other);
+    }
+    else {
+      sched_yield();
+    }
+  }
+  void *o = t->result;
+  free(t);
+  return o;
+}
+
+/* enough pieces that every worker gets several, so stealing evens out
+uneven work, but not so many that the splitting costs more than it saves */
+size_t
+sched_grain(size_t n) {
+  size_t workers = _sched.n > 0 ? (size_t)_sched.n : 1;
+  size_t g = n / (8 * workers);
+  return g > 0 ? g : 1;
+}
+
+typedef struct forjob {
+  void (*body)(void *, size_t, size_t);
+  void *ctx;
+  size_t grain;
+} forjob;
+
+static void forsplit(forjob *j, size_t lo, size_t hi);
+
+static void
+runrange(task *t) {
+  forsplit(t->ctx, t->lo, t->hi);
+}
+
+/* hands off the upper half until what's left is one grain, runs that,
+then syncs the halves it gave away (newest first) */
+static void
+forsplit(forjob *j, size_t lo, size_t hi) {
+  task *kids[MAX_SPLITS];
+  int nk = 0;
+  while (hi - lo > j->grain && nk < MAX_SPLITS) {
+    size_t mid = lo + (hi - lo) / 2;
+    task *t = newtask(runrange);
+    t->ctx = j;
+    t->lo = mid;
+    t->hi = hi;
+    push(t);
+    kids[nk++] = t;
+    hi = mid;
+  }
+  (*j->body)(j->ctx, lo, hi);
+  while (nk > 0) {
+    sched_sync(kids[--nk]);
+  }
+}
+
+void
+sched_for(size_t n, void (*body)(void *, size_t, size_t), void *ctx) {
+  forjob j;
+  if (n == 0) {
+    return;
+  }
+  if (_sched.n == 0) {
+    sched_init(0);
+  }
+  j.body = body;
+  j.ctx = ctx;
+  j.grain = sched_grain(n);
+  if (_sched.n == 1) {
+    j.grain = n;
+  }
+  forsplit(&j, 0, n);
+}
+
+void
+sched_stats(int worker, schedstats *s) {
+  s->tasks = s->steals = s->idle = 0;
+  for (int i = 0; i < _sched.n; ++i) {
+    if (worker == -1 || worker == i) {
+      s->tasks += atomic_load(&_sched.workers[i].tasks);
+      s->steals += atomic_load(&_sched.workers[i].steals);
+      s->idle += atomic_load(&_sched.workers[i].idle);
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef WSCHED_H
+#define WSCHED_H
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "closure.h"
+
+/* a work-stealing scheduler.  every worker has its own deque: it pushes
+and pops its own tasks at the bottom, and idle workers steal from the
+top of somebody else's.  sched_sync never just blocks, it runs other
+tasks until the one it's waiting on is done, so parallel code can call
+parallel code without deadlocking the pool. */
+typedef struct task task;
+struct task {
+  void (*run)(task *);
+  void (*fn)(void *);
+  void *ctx;
+  size_t lo;
+  size_t hi;
+  closure *cl;
+  envobj *arg;
+  void *result;
+  bool detached; /* nobody syncs it; it's freed when it has run */
+  atomic_int done;
+};
+
+typedef struct schedstats {
+  unsigned long tasks;  /* tasks run */
+  unsigned long steals; /* tasks taken from another worker's deque */
+  unsigned long idle;   /* times a worker found nothing to do and slept */
+} schedstats;
+
+void sched_init(int nworkers); /* 0 means one per cpu; the caller is worker 0 */
+int sched_size(void);
+void sched_shutdown(void);
+
+/* fork/join.  every spawned task must be synced exactly once; sync
+returns the closure's result and frees the task */
+task *sched_spawn(closure *cl, envobj *arg);
+task *sched_spawn_fn(void (*fn)(void *), void *ctx);
+void *sched_sync(task *t);
+
+/* fire and forget: fn(ctx) runs on the pool and nobody syncs it, so
+it has to report back some other way (future.h does).  sched_help runs
+one waiting task on the calling thread, if there is one, for code that
+waits on something other than sched_sync */
+void sched_post(void (*fn)(void *), void *ctx);
+bool sched_help(void);
+
+/* parallel for over [0, n): the range is split in halves, recursively,
+down to sched_grain(n) indices, and body(ctx, lo, hi) runs on each piece */
+size_t sched_grain(size_t n);
+void sched_for(size_t n, void (*body)(void *, size_t, size_t), void *ctx);
+
+/* per worker counters, or the totals for worker -1 */
+void sched_stats(int worker, schedstats *s);
+
+#endif